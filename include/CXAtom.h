@@ -2,11 +2,30 @@
 #define CX_ATOM_H
 
 #include <std_Xt.h>
-#include <map>
+#include <deque>
 #include <string>
+#include <unordered_map>
 
 class CXMachine;
-class CXAtom;
+
+class CXAtom {
+ public:
+  CXAtom(const std::string &name="", Atom xatom=0);
+
+  std::string getName () const { return name_ ; }
+
+  Atom getXAtom() const { return xatom_; }
+
+  bool isXAtom(Atom xatom) const { return xatom == xatom_; }
+
+  bool operator==(const CXAtom &atom) const { return xatom_ == atom.xatom_; }
+
+ private:
+  std::string name_;
+  Atom        xatom_ { 0 };
+};
+
+//------
 
 class CXAtomMgr {
  public:
@@ -45,6 +64,8 @@ class CXAtomMgr {
   const CXAtom &getCXAtom(const std::string &name);
   const CXAtom &getCXAtom(Atom atom);
 
+  void preloadAtoms();
+
  private:
   const CXAtom *XA_WM_PROTOCOLS     { nullptr };
   const CXAtom *XA_WM_TAKE_FOCUS    { nullptr };
@@ -56,29 +77,17 @@ class CXAtomMgr {
   const CXAtom *XA_XSETROOT_ID      { nullptr };
   const CXAtom *XA_CWM_DESKTOP      { nullptr };
 
-  typedef std::map<std::string, CXAtom *> CXAtomMap;
-
-  CXMachine& machine_;
-  CXAtomMap  atom_map_;
-};
-
-//------
-
-class CXAtom {
- public:
-  CXAtom(const std::string &name="", Atom xatom=0);
-
-  std::string getName () const { return name_ ; }
-
-  Atom getXAtom() const { return xatom_; }
-
-  bool isXAtom(Atom xatom) const { return xatom == xatom_; }
-
-  bool operator==(const CXAtom &atom) const { return xatom_ == atom.xatom_; }
+  const CXAtom &addAtom(const std::string &name, Atom xatom);
 
  private:
-  std::string name_;
-  Atom        xatom_ { 0 };
+  typedef std::unordered_map<std::string, CXAtom *> CXAtomNameMap;
+  typedef std::unordered_map<Atom, CXAtom *>        CXAtomMap;
+  typedef std::deque<CXAtom>                        CXAtoms;
+
+  CXMachine&    machine_;
+  CXAtoms       atoms_;
+  CXAtomNameMap name_map_;
+  CXAtomMap     atom_map_;
 };
 
 #endif
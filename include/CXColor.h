@@ -3,30 +3,11 @@
 
 #include <CRGBA.h>
 #include <std_Xt.h>
-#include <map>
+#include <deque>
 #include <memory>
+#include <vector>
 
 class CXScreen;
-class CXColor;
-
-class CXColorMgr {
- public:
-  CXColorMgr();
-  CXColorMgr(CXScreen &screen);
- ~CXColorMgr();
-
-  const CXColor &getCXColor(const CRGB &rgb);
-  const CXColor &getCXColor(const CRGBA &rgba);
-  const CXColor &getCXColor(Pixel pixel);
-
- private:
-  typedef std::map<Pixel, CXColor *> CXColorMap;
-
-  CXScreen&  screen_;
-  CXColorMap colormap_;
-};
-
-//------
 
 class CXColor {
  public:
@@ -106,4 +87,62 @@ class CXColor {
   ColorP    inverse_color_;
 };
 
+//------
+
+// colors keyed by packed 8 bit RGBA (or pixel) in flat open addressing
+// hashes, stored in a slab (deque keeps references stable) with a small
+// direct mapped cache of recent RGBA lookups in front
+class CXColorMgr {
+ public:
+  CXColorMgr();
+  CXColorMgr(CXScreen &screen);
+ ~CXColorMgr();
+
+  const CXColor &getCXColor(const CRGB &rgb);
+  const CXColor &getCXColor(const CRGBA &rgba);
+  const CXColor &getCXColor(Pixel pixel);
+
+  // forget cached lookups (colormap or its allocated colors changed). Colors
+  // already returned stay valid but are not reused
+  void clearIndex();
+
+ private:
+  // key -> slab index + 1 (0 for not found), linear probing
+  class IndexHash {
+   public:
+    uint find(uint key) const;
+
+    void insert(uint key, uint ind);
+
+    void clear();
+
+   private:
+    void grow();
+
+   private:
+    struct Slot {
+      uint key { 0 };
+      uint ind { 0 };
+    };
+
+    std::vector<Slot> slots_;
+    uint              num_ { 0 };
+  };
+
+  struct CacheEntry {
+    uint           key   { 0 };
+    const CXColor *color { nullptr };
+  };
+
+  enum { CACHE_SIZE = 16 };
+
+  using Colors = std::deque<CXColor>;
+
+  CXScreen&  screen_;
+  Colors     colors_;
+  IndexHash  rgba_index_;
+  IndexHash  pixel_index_;
+  CacheEntry cache_[CACHE_SIZE];
+};
+
 #endif
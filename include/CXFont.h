@@ -3,9 +3,9 @@
 
 #include <std_Xt.h>
 #include <CFont.h>
+#include <CXrtFont.h>
 
 class CXScreen;
-class CXrtFont;
 class CXFont;
 
 class CXFont : public CFont {
@@ -54,11 +54,23 @@ class CXFont : public CFont {
   double getStringWidth (const std::string &str) const override { return getIStringWidth(str); }
   uint   getIStringWidth(const std::string &str) const override;
 
+  // width of each string (for layout of many strings)
+  void getStringWidths(const std::vector<std::string> &strs, std::vector<uint> &widths) const;
+
+  // widths[i] is width of first i chars of str (str.size() + 1 values)
+  void getPrefixWidths(const std::string &str, std::vector<uint> &widths) const;
+
+  // number of leading chars of str which fit in width
+  uint getFitLength(const std::string &str, uint width) const;
+
+  // number of leading chars which fit in width from prefix widths (binary search)
+  static uint getFitLength(const std::vector<uint> &widths, uint width);
+
   bool isProportional() const override { return proportional_; }
 
   double getCharAspect() const override { return font_aspect_; }
 
-  CXrtFont *getXrtFont() const { return xrt_font_; }
+  CXrtFont *getXrtFont() const { return xrt_font_.get(); }
 
   CImagePtr getStringImage(const std::string &str) override;
 
@@ -75,7 +87,7 @@ class CXFont : public CFont {
 
   CXScreen    &screen_;
   CFontFamily &font_family_;
-  CXrtFont    *xrt_font_     { nullptr };
+  CXrtFontP    xrt_font_;
   uint         font_width_   { 0 };
   uint         font_ascent_  { 0 };
   uint         font_descent_ { 0 };
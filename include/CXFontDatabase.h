@@ -0,0 +1,92 @@
+#ifndef CX_FONT_DATABASE_H
+#define CX_FONT_DATABASE_H
+
+#define CXFontDatabaseInst CXFontDatabase::getInstance()
+
+#include <std_Xt.h>
+#include <CFontStyle.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Catalogue of server fonts indexed by family and style with sizes sorted
+// for nearest size lookup. The decoded list can be saved to a cache file
+// (set by setCacheFile or CX_LIB_FONT_CACHE) which is reused, without
+// listing fonts, while the server vendor/release, font path and modification
+// times of local font path directories are unchanged. Use reload after
+// font changes the key can't see (e.g. font server or xset fp rehash)
+class CXFontDatabase {
+ public:
+  struct Font {
+    std::string name;
+    std::string family;
+    CFontStyle  style { CFONT_STYLE_NORMAL };
+    uint        size  { 0 }; // 0 for scalable
+    uint        x_res { 0 };
+    uint        y_res { 0 };
+  };
+
+ public:
+  static CXFontDatabase *getInstance();
+
+  const std::string &getCacheFile() const { return cache_file_; }
+  void setCacheFile(const std::string &file) { cache_file_ = file; }
+
+  // load fonts of display (from cache file if valid)
+  bool load();
+
+  // reload fonts from server (ignoring and rewriting cache file)
+  bool reload();
+
+  bool isLoaded() const { return loaded_; }
+
+  void clear();
+
+  uint getNumFonts() const { return uint(fonts_.size()); }
+
+  const Font &getFont(uint i) const { return fonts_[i]; }
+
+  void getFamilies(std::vector<std::string> &families) const;
+
+  // fonts of family and style sorted by size (best resolution first)
+  void getFonts(const std::string &family, CFontStyle style,
+                std::vector<const Font *> &fonts) const;
+
+  // font of exact size (nullptr if none)
+  const Font *lookup(const std::string &family, CFontStyle style, uint size) const;
+
+  // font of exact size, else scalable font, else font of nearest size
+  const Font *lookupNearest(const std::string &family, CFontStyle style, uint size) const;
+
+ private:
+  CXFontDatabase();
+
+  CXFontDatabase(const CXFontDatabase &rhs);
+  CXFontDatabase &operator=(const CXFontDatabase &rhs);
+
+  bool loadFonts(bool use_cache);
+
+  void getServerKey(Display *display, std::vector<std::string> &key) const;
+
+  bool readCache (const std::vector<std::string> &key);
+  bool writeCache(const std::vector<std::string> &key) const;
+
+  void buildIndex();
+
+  const std::vector<uint> *getIndex(const std::string &family, CFontStyle style) const;
+
+  std::vector<uint>::const_iterator
+    lowerBound(const std::vector<uint> &index, uint size) const;
+
+ private:
+  typedef std::vector<Font>                            Fonts;
+  typedef std::pair<std::string, int>                  FamilyStyle;
+  typedef std::map<FamilyStyle, std::vector<uint> >    Index;
+
+  std::string cache_file_;
+  bool        loaded_ { false };
+  Fonts       fonts_;
+  Index       index_;
+};
+
+#endif
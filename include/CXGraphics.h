@@ -6,8 +6,12 @@
 #include <CFont.h>
 #include <CXColor.h>
 #include <CImage.h>
+#include <CIPoint2D.h>
 #include <CFontStyle.h>
+#include <X11/extensions/Xrender.h>
+#include <map>
 #include <memory>
+#include <vector>
 
 enum CXLineType {
   CX_LINE_TYPE_SOLID,
@@ -67,9 +71,16 @@ class CXGraphics {
   void drawRectangle(int x, int y, int width, int height);
   void fillRectangle(int x, int y, int width, int height);
 
+  // polyline/polygon of any size (coordinates are clipped to the X 16 bit range)
   void drawPolygon(int *x, int *y, int num_xy);
   void fillPolygon(int *x, int *y, int num_xy);
 
+  void drawPolygon(const CIPoint2D *points, uint num_points);
+  void fillPolygon(const CIPoint2D *points, uint num_points);
+
+  void drawPolygon(const std::vector<CIPoint2D> &points);
+  void fillPolygon(const std::vector<CIPoint2D> &points);
+
   void drawCircle(int x, int y, int r);
   void fillCircle(int x, int y, int r);
 
@@ -120,6 +131,18 @@ class CXGraphics {
 
   void setFillComplex(bool comp);
 
+  // batch lines, points, rectangles and arcs into multi primitive requests
+  // (always done in double buffer, flushed by copyDoubleBuffer)
+  bool getBatchDraw() const { return batch_draw_; }
+  void setBatchDraw(bool batch);
+
+  // allow batched primitives of different colors to be reordered so each
+  // color is only set once per flush (only if overlap order does not matter)
+  bool getBatchSort() const { return batch_sort_; }
+  void setBatchSort(bool sort);
+
+  void flushDraw();
+
   void getSize(int *width, int *height) const;
 
   int getCharWidth();
@@ -134,13 +157,65 @@ class CXGraphics {
 
   bool isPixmapWindow() const;
 
-  static int newErrorHandler(Display *display, XErrorEvent *event);
+  Drawable getDrawable() const;
+
+  void getImageRow(const CImagePtr &image, int x, int y, int n, uint *row) const;
+
+  bool    useRender() const;
+  Picture getRenderPicture();
+  Picture getRenderFill();
+  void    resetRenderPicture();
+  bool    fillRenderPolygon(const std::vector<XPointDouble> &points);
 
  private:
-  enum { MAX_POLY_POINTS=100 };
+  enum { MAX_BATCH_SIZE=65536 };
 
   using PixmapP = std::unique_ptr<CXPixmap>;
 
+  struct Clip {
+    bool       active { false };
+    XRectangle rect   { 0, 0, 0, 0 };
+    Pixmap     mask   { 0 };
+    int        dx     { 0 };
+    int        dy     { 0 };
+  };
+
+  // primitives batched for one foreground pixel (same GC state so their
+  // order does not change the result)
+  struct DrawBatch {
+    std::vector<XSegment>   segments;
+    std::vector<XPoint>     points;
+    std::vector<XRectangle> rects;
+    std::vector<XRectangle> fill_rects;
+    std::vector<XArc>       arcs;
+    std::vector<XArc>       fill_arcs;
+  };
+
+  typedef std::map<Pixel, DrawBatch> DrawBatches;
+
+  DrawBatch *getDrawBatch();
+
+  void addArc(int x, int y, int xr, int yr, int angle1, int angle2, bool fill);
+
+  // polygon points from x/y arrays or point array (referenced, not copied)
+  struct PolySource {
+    const int       *x      { nullptr };
+    const int       *y      { nullptr };
+    const CIPoint2D *points { nullptr };
+    uint             num    { 0 };
+
+    int getX(uint i) const { return (points ? points[i].x : x[i]); }
+    int getY(uint i) const { return (points ? points[i].y : y[i]); }
+  };
+
+  void drawPolySource(const PolySource &source);
+  void fillPolySource(const PolySource &source);
+
+  void drawPolyRun();
+
+  uint getMaxRequestPoints(uint header_size) const;
+
+ private:
   CXScreen& screen_;
   Window    window_           { 0 };
   Display*  display_          { nullptr };
@@ -152,9 +227,21 @@ class CXGraphics {
   PixmapP   pixmap_;
   bool      in_double_buffer_ { false };
   bool      fill_complex_     { false };
-
-  static bool   error_trapped;
-  static XPoint poly_point[MAX_POLY_POINTS];
+  bool      is_xor_           { false };
+  Clip      clip_;
+  Picture   picture_          { 0 };
+  Drawable  picture_drawable_ { 0 };
+  bool      picture_clip_     { false };
+  Picture   fill_picture_     { 0 };
+  Pixel     fill_pixel_       { 0 };
+
+  bool        batch_draw_ { false };
+  bool        batch_sort_ { false };
+  DrawBatches batches_;
+  uint        batch_size_ { 0 };
+
+  std::vector<XPoint>       poly_points_;
+  std::vector<XPointDouble> poly_dpoints_;
 };
 
 #endif
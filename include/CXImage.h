@@ -4,6 +4,7 @@
 class CXScreen;
 
 #include <std_Xt.h>
+#include <X11/extensions/Xrender.h>
 #include <CImage.h>
 #include <CXColor.h>
 
@@ -60,6 +61,10 @@ class CXImage : public CImage {
   int       getDepth   () const;
   Pixmap    getXPixmap () const;
   Pixmap    getXMask   () const;
+  Picture   getXPicture() const;
+
+  void getMaskBits(std::vector<uchar> &bits, uint *bytes_per_line) const;
+  void getMaskSpans(std::vector<XRectangle> &spans) const;
 
   void draw(Display *display, Drawable drawable, GC gc, int x, int y);
   void draw(CXScreen *cxscreen, Drawable drawable, GC gc, int x, int y);
@@ -95,6 +100,10 @@ class CXImage : public CImage {
   void reset();
   void createXImage();
   void initXImage();
+  bool initXImageRows();
+  bool initXImageDither();
+
+  void getARGBRow(int y, int x1, int n, uint *row) const;
 
   int getDataSize();
   int getRowSize();
@@ -106,6 +115,7 @@ class CXImage : public CImage {
   bool      ximage_owner_ { false };
   Pixmap    pixmap_ { 0 };
   Pixmap    mask_ { 0 };
+  Picture   picture_ { 0 };
 };
 
 #endif
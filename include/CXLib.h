@@ -10,14 +10,19 @@
 #include <CXCursor.h>
 #include <CXDragWindow.h>
 #include <CXFont.h>
+#include <CXFontDatabase.h>
 #include <CXGraphics.h>
 #include <CXMachine.h>
 #include <CXNamedEvent.h>
 #include <CXPixmap.h>
+#include <CXPropertyBatch.h>
 #include <CXScreen.h>
+#include <CXSelection.h>
 #include <CXTimer.h>
 #include <CXUtil.h>
 #include <CXWindow.h>
+#include <CXWindowCache.h>
+#include <CXWindowRegistry.h>
 #include <CXtTimer.h>
 
 #endif
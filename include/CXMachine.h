@@ -4,10 +4,13 @@
 #define CXMachineInst CXMachine::getInstance()
 
 #include <std_Xt.h>
+#include <X11/extensions/Xrender.h>
 #include <CFont.h>
 #include <CRGBA.h>
 #include <CEvent.h>
 #include <CIPoint2D.h>
+#include <CXWindowRegistry.h>
+#include <CXWindowCache.h>
 #include <Xm/MwmUtil.h>
 #include <vector>
 #include <memory>
@@ -34,29 +37,60 @@ class CXScreen;
 class CXWindow;
 class CXPixmap;
 class CXAtomMgr;
+class CXSelection;
 class CXAtom;
 class CXColor;
 
 typedef void (*CXMachineEventProc)(CXMachine *machine, XEvent *event);
+typedef void (*CXMachineFdProc)(CXMachine *machine, int fd, short revents, void *data);
+
+// what tickLoop does when a frame overruns its deadline
+enum CXFramePolicy {
+  CX_FRAME_SKIP,    // drop missed frames and stay on the frame grid
+  CX_FRAME_CATCH_UP // run missed frames back to back (bounded)
+};
+
+// queued events merged before dispatch by processEvent (opt-in)
+enum CXEventCompress {
+  CX_COMPRESS_NONE      = 0,
+  CX_COMPRESS_MOTION    = (1<<0), // consecutive motion -> latest position
+  CX_COMPRESS_EXPOSE    = (1<<1), // window exposes -> one damage region
+  CX_COMPRESS_CONFIGURE = (1<<2), // window configures -> final geometry
+  CX_COMPRESS_ALL       = (CX_COMPRESS_MOTION | CX_COMPRESS_EXPOSE | CX_COMPRESS_CONFIGURE)
+};
+
+struct CXFrameStats {
+  ulong  frames { 0 }; // frames run
+  ulong  missed { 0 }; // frame deadlines missed
+  double mean   { 0 }; // mean frame interval (msecs)
+  double p99    { 0 }; // 99th percentile frame interval (msecs)
+};
 
 class CXEventAdapter;
 
 #define CXLIB_ALL_FONTS_PATTERN "-*-*-*-*-*-*-*-*-*-*-*-*-*-*"
 
-enum { CXLIB_MAX_FONTS = 1000 };
-
+// font names matching pattern (max_fonts of 0 lists all fonts). A request
+// can return at most 65535 names so larger lists are split into several
+// patterns (names are then sorted)
 class CXFontList {
  public:
-  CXFontList(const char *pattern=CXLIB_ALL_FONTS_PATTERN, uint max_fonts=CXLIB_MAX_FONTS);
- ~CXFontList();
+  enum { MAX_LIST_FONTS = 65535 };
 
-  uint getNumFonts() const { return uint(num_fonts_); }
+ public:
+  CXFontList(const char *pattern=CXLIB_ALL_FONTS_PATTERN, uint max_fonts=0);
 
-  const char *getFont(uint i) const { return fonts_[i]; }
+  uint getNumFonts() const { return uint(fonts_.size()); }
+
+  const char *getFont(uint i) const { return fonts_[i].c_str(); }
+
+ private:
+  void addFonts(const std::string &pattern, std::string::size_type pos, int max_names);
 
  private:
-  char **fonts_ { nullptr };
-  int    num_fonts_ { 0 };
+  typedef std::vector<std::string> Fonts;
+
+  Fonts fonts_;
 };
 
 //------
@@ -81,6 +115,9 @@ class CXMachine {
 
   CXEventAdapter *getEventAdapter() const { return event_adapter_.get(); }
 
+  // cleared by default idleEvent so mainLoop knows no idle handler ran
+  void setIdleHandler(bool b) { idle_handler_ = b; }
+
   Time getLastEventTime() const { return event_last_time_; }
 
   bool getIsShift() const { return event_modifier_ & CMODIFIER_SHIFT  ; }
@@ -110,6 +147,14 @@ class CXMachine {
 
   void setPedantic(bool flag) { pedantic_ = flag; }
 
+  void setUseShm(bool flag) { use_shm_ = flag; shm_checked_ = false; }
+
+  void setUseRender(bool flag) { use_render_ = flag; render_checked_ = false; }
+
+  // cache window geometry, attributes and WM properties (see CXWindowCache)
+  bool getWindowCache() const { return window_cache_.isEnabled(); }
+  void setWindowCache(bool flag) { window_cache_.setEnabled(flag); }
+
   void init();
 
   Display *openDisplay  (const std::string &display_name="");
@@ -149,8 +194,23 @@ class CXMachine {
   void mainLoop(uint twait=10, CXEventAdapter *adapter=nullptr);
   void tickLoop(uint nframes=30, CXEventAdapter *adapter=nullptr);
 
+  void setFramePolicy(CXFramePolicy policy) { frame_policy_ = policy; }
+
+  void getFrameStats(CXFrameStats &stats) const;
+
+  void addFdHandler(int fd, short events, CXMachineFdProc proc, void *data=nullptr);
+  void removeFdHandler(int fd);
+
+  bool waitForEvents(int timeout_msecs);
+
   bool processEvent();
 
+  void setEventCompress(uint flags) { event_compress_ = flags; }
+  uint getEventCompress() const { return event_compress_; }
+
+  // area exposed (valid during CEventAdapter::exposeEvent)
+  Region getExposeRegion() const { return expose_region_; }
+
   XEvent *getEvent() { return &event_; }
 
   KeySym       getEventKeysym() const;
@@ -216,6 +276,8 @@ class CXMachine {
 
   CXWindow *lookupWindow(Window xwin) const;
 
+  CXWindowRegistry &getWindowRegistry() { return window_registry_; }
+
   bool isValidWindow(Window xwin) const;
 
   int getMulticlickTime() const;
@@ -344,6 +406,8 @@ class CXMachine {
   bool isWMStateIconic(Window xwin);
   int  getWMState(Window xwin);
 
+  void getWMStates(const std::vector<Window> &xwins, std::vector<int> &states);
+
   bool getWMName(Window xwin, std::string &name);
   bool getWMIconName(Window xwin, std::string &name);
 
@@ -476,6 +540,9 @@ class CXMachine {
 
   Pixmap createStipplePixmap();
 
+  Pixmap createXBitmap(const uchar *bits, uint width, uint height);
+  Pixmap createXBitmap(Window xwin, const uchar *bits, uint width, uint height);
+
   void drawImage(Window xwin, GC gc, const CImagePtr &image, int x, int y);
   void drawImage(Window xwin, GC gc, const CImagePtr &image,
                  int src_x, int src_y, int dst_x, int dst_y,
@@ -486,6 +553,29 @@ class CXMachine {
   void putImage(Window xwin, GC gc, XImage *ximage, int src_x, int src_y,
                 int dst_x, int dst_y, uint width, uint height);
 
+  // image of drawable area (plain image freed with XDestroyImage)
+  XImage *getImage(Window xwin, int x, int y, uint width, uint height);
+
+  // image of drawable area which may use shared memory (freed with destroyImage)
+  XImage *getShmImage(Window xwin, int x, int y, uint width, uint height);
+
+  // smaller images (in pixels) don't use shared memory (segment setup and
+  // release cost round trips)
+  enum { SHM_MIN_PIXELS = 128*128 };
+
+  bool    hasShmImage() const;
+  XImage *createShmImage(Visual *visual, uint depth, uint width, uint height);
+  bool    isShmImage(XImage *ximage) const;
+  void    syncShmImage(XImage *ximage);
+  void    destroyShmImage(XImage *ximage);
+  void    destroyImage(XImage *ximage);
+
+  bool    hasRender() const;
+  Picture createPicture(Drawable drawable);
+  Picture createARGBPicture(const uint *data, uint width, uint height);
+  Picture createSolidPicture(const CRGBA &rgba);
+  void    freePicture(Picture picture);
+
   XFontStruct *loadFont(const char *name);
 
   const CXAtom &getAtom(const std::string &name) const;
@@ -512,12 +602,22 @@ class CXMachine {
   std::string getEventName  (XEvent *event) const;
   Time        getEventTime  (XEvent *event) const;
 
+  // trap errors of requests made until the matching trapEnd (traps nest).
+  // Errors are attributed by request serial so trapEnd only syncs if the
+  // server has not yet answered the last trapped request
   void trapStart() const;
   bool trapEnd  () const;
 
+  // end trap without waiting, errors of its requests are ignored
+  void trapEndAsync() const;
+
  private:
   static int XErrorHandler(Display *display, XErrorEvent *event);
 
+  bool trapError(const XErrorEvent *event);
+
+  void pruneTraps();
+
  public:
   void setXErrorProc(XErrorProc error_proc);
 
@@ -535,11 +635,16 @@ class CXMachine {
 
   bool        selectionSetText(Window xwin, const std::string &text);
   void        selectionResetText(Window xwin);
-  void        selectionClearEvent();
+  void        selectionClearEvent(XSelectionClearEvent *event);
   void        selectionRequestEvent(XSelectionRequestEvent *event);
   void        selectionNotifyEvent(XSelectionEvent *event);
   std::string selectionGetText(Window xwin);
 
+  bool        clipboardSetText(Window xwin, const std::string &text);
+  std::string clipboardGetText(Window xwin);
+
+  CXSelection &getSelection() { return *selection_; }
+
   const CXColor &getCXColor(const CRGB &rgb);
   const CXColor &getCXColor(const CRGBA &rgba);
   const CXColor &getCXColor(Pixel pixel);
@@ -554,17 +659,50 @@ class CXMachine {
   bool getMonitorWidthMM(double *width);
   bool getMonitorHeightMM(double *height);
 
+  void processPendingEvents();
+
+  bool queryWindowAttributes(Window xwin, XWindowAttributes &attr, bool map_state) const;
+
+  bool getDrawableFormat(Drawable drawable, Visual **visual, uint *depth) const;
+
+  XImage *createShmGetImage(Visual *visual, uint depth, uint width, uint height);
+  void    releaseShmSegment();
+
+  // forget extension state of display (before it is closed or changed)
+  void resetExtensions();
+
+  CXWindowCache::Entry *getPropertyCacheEntry(Window xwin);
+
+  void cacheEvent(const XEvent *event) const;
+
+  void compressEvent();
+  void addExposeRect(const XExposeEvent &event);
+
+  void waitFrameDeadline(long long deadline, int timer_fd, bool &due);
+
+  void addFrameTime(long long nsecs);
+
  private:
   struct MaximizeData {
     int x, y, width, height;
   };
 
+  struct FdHandler {
+    int             fd     { -1 };
+    short           events { 0 };
+    CXMachineFdProc proc   { nullptr };
+    void*           data   { nullptr };
+  };
+
+  typedef std::vector<FdHandler> FdHandlers;
+
   typedef std::map<int, Display  *>      DisplayMap;
   typedef std::map<int, CXScreen *>      CXScreenMap;
   typedef std::map<Window, MaximizeData> MaximizeDataMap;
 
   using EventAdapterP = std::unique_ptr<CXEventAdapter>;
   using AtomMgrP      = std::unique_ptr<CXAtomMgr>;
+  using SelectionP    = std::unique_ptr<CXSelection>;
 
   Display*     display_     { nullptr };
   std::string  display_name_;
@@ -575,6 +713,7 @@ class CXMachine {
   XtAppContext app_context_ { nullptr };
 
   EventAdapterP event_adapter_;
+  bool          idle_handler_         { false };
   XEvent        event_;
   Time          event_last_time_      { 0 };
   Window        event_win_            { None };
@@ -585,25 +724,64 @@ class CXMachine {
   int           event_button_count_   { 0 };
   KeySym        event_keysym_         { 0 };
   uint          event_modifier_       { CMODIFIER_NONE };
+  uint          event_compress_       { CX_COMPRESS_NONE };
+  Region        expose_region_        { nullptr };
+  Window        expose_win_           { None };
 
   bool pedantic_ { false };
 
-  bool trap_active_       { false };
-  int  trap_request_code_ { 0 };
-  int  trap_error_code_   { 0 };
+  bool use_shm_       { true };
+  bool shm_checked_   { false };
+  bool shm_available_ { false };
+
+  ulong shm_put_serial_ { 0 };
+
+  // reusable segment for getShmImage (XShmSegmentInfo)
+  void  *shm_get_info_ { nullptr };
+  size_t shm_get_size_ { 0 };
+  bool   shm_get_busy_ { false };
+
+  bool use_render_       { true };
+  bool render_checked_   { false };
+  bool render_available_ { false };
+
+  struct ErrorTrap {
+    ulong start_serial { 0 };
+    ulong end_serial   { 0 };
+    int   request_code { 0 };
+    int   error_code   { 0 };
+  };
+
+  typedef std::vector<ErrorTrap> ErrorTraps;
+
+  ErrorTraps traps_;
+  ErrorTraps ended_traps_;
+  int        trap_request_code_ { 0 };
+  int        trap_error_code_   { 0 };
 
   DisplayMap  displays_;
   CXScreenMap screens_;
 
   MaximizeDataMap max_data_map_;
 
+  CXWindowRegistry window_registry_;
+  CXWindowCache    window_cache_;
+
+  FdHandlers fd_handlers_;
+
+  enum { MAX_FRAME_TIMES = 512, MAX_CATCH_UP_FRAMES = 4 };
+
+  CXFramePolicy       frame_policy_ { CX_FRAME_SKIP };
+  std::vector<double> frame_times_;
+  uint                frame_pos_    { 0 };
+  ulong               frame_count_  { 0 };
+  ulong               frame_missed_ { 0 };
+
   AtomMgrP atomMgr_;
 
   XErrorProc error_proc_ { 0 };
 
-  Window      selection_xwin_ { None };
-  bool        selection_set_  { false };
-  std::string selection_text_;
+  SelectionP selection_;
 };
 
 #include <CXEventAdapter.h>
@@ -0,0 +1,91 @@
+#ifndef CX_PROPERTY_BATCH_H
+#define CX_PROPERTY_BATCH_H
+
+#include <std_Xt.h>
+#include <string>
+#include <vector>
+
+class CXAtom;
+
+// reply to a queued GetProperty request (data is in wire format, i.e.
+// 32 bit items are 4 bytes each, and is nul terminated)
+struct CXPropertyReply {
+  Window                     xwin        { None };
+  Atom                       name        { None };
+  Atom                       type        { None };
+  int                        format      { 0 };
+  ulong                      num_items   { 0 };
+  ulong                      bytes_after { 0 };
+  std::vector<unsigned char> data;
+  bool                       valid       { false };
+
+  bool exists() const { return valid && type != None; }
+
+  uint getCard32(ulong i) const;
+
+  bool getInteger(int *value) const;
+  bool getString(std::string &value) const;
+  bool getWindows(std::vector<Window> &windows) const;
+  bool getAtoms(std::vector<CXAtom> &atoms) const;
+};
+
+typedef void (*CXPropertyProc)(const CXPropertyReply &reply, void *data);
+
+// batch of window property queries : all queued GetProperty requests are
+// written in one go and their replies collected by an async reply handler
+// during a single round trip (instead of one round trip per property)
+class CXPropertyBatch {
+ public:
+  CXPropertyBatch();
+  CXPropertyBatch(Display *display);
+
+ ~CXPropertyBatch();
+
+  // queue request, returns reply index
+  uint add(Window xwin, const CXAtom &name, Atom type=AnyPropertyType,
+           long max_length=1024, CXPropertyProc proc=nullptr, void *data=nullptr);
+  uint add(Window xwin, Atom name, Atom type=AnyPropertyType,
+           long max_length=1024, CXPropertyProc proc=nullptr, void *data=nullptr);
+
+  // write queued requests (replies are handled as they arrive)
+  void send();
+
+  // wait for all replies of sent requests and run callbacks
+  void wait();
+
+  // send and wait
+  void fetch();
+
+  void clear();
+
+  uint getNumReplies() const { return uint(replies_.size()); }
+
+  const CXPropertyReply &getReply(uint i) const { return replies_[i]; }
+
+  bool handleReply(Display *display, void *rep, char *buf, int len);
+
+ private:
+  CXPropertyBatch(const CXPropertyBatch &rhs);
+  CXPropertyBatch &operator=(const CXPropertyBatch &rhs);
+
+ private:
+  struct Request {
+    long           max_length { 1024 };
+    CXPropertyProc proc       { nullptr };
+    void          *data       { nullptr };
+  };
+
+  typedef std::vector<Request>         Requests;
+  typedef std::vector<CXPropertyReply> Replies;
+
+  Display  *display_   { nullptr };
+  Requests  requests_;
+  Replies   replies_;
+  uint      num_sent_  { 0 };
+  uint      first_     { 0 };
+  ulong     first_seq_ { 0 };
+  ulong     last_seq_  { 0 };
+  void     *async_     { nullptr };
+};
+
+#endif
@@ -4,10 +4,25 @@
 #include <std_Xt.h>
 #include <CImageLib.h>
 #include <CXColor.h>
+#include <unordered_map>
 
 class CXColorMgr;
 class CXWindow;
 
+enum CXDitherType {
+  CX_DITHER_NONE,
+  CX_DITHER_ORDERED,
+  CX_DITHER_ERROR_DIFFUSION
+};
+
+// fixed color cube used to dither images on colormap visuals
+struct CXDitherPalette {
+  enum { LEVELS = 6, SIZE = LEVELS*LEVELS*LEVELS };
+
+  Pixel pixels[SIZE]; // cell for cube entry
+  uint  colors[SIZE]; // actual 0xRRGGBB of cell
+};
+
 class CXScreen {
  public:
   CXScreen(int screen_num);
@@ -55,6 +70,11 @@ class CXScreen {
 
   void      setGrayScale();
 
+  CXDitherType getDitherType() const { return dither_type_; }
+  void         setDitherType(CXDitherType type) { dither_type_ = type; }
+
+  const CXDitherPalette *getDitherPalette();
+
   CRGB      pixelToRGB(Pixel pixel);
   CRGBA     pixelToRGBA(Pixel pixel);
 
@@ -87,10 +107,14 @@ class CXScreen {
   void setColorsUsed();
   void freeAllocatedColors();
 
+  void resetColorIndex();
+  void addColorIndex(int i);
+  int  nearestColor(uint r, uint g, uint b);
+
   void decodeVisualMask(uint full_mask, int *shift, uint *mask);
 
  private:
-  typedef std::map<Window,CXWindow *> WindowMap;
+  typedef std::unordered_map<uint,int> ColorIndexMap;
 
   Display    *display_ { nullptr };
   int         screen_num_ { 0 };
@@ -109,12 +133,21 @@ class CXScreen {
   int                 num_used_colors_ { 0 };
   std::vector<bool>   color_used_;
   std::vector<bool>   color_allocated_;
+  int                 free_color_ { 0 };
+
+  // packed 8 bit rgb -> cell and 32x32x32 rgb cube -> nearest cell
+  ColorIndexMap       color_index_;
+  std::vector<ushort> inverse_map_;
+  std::vector<uint>   inverse_dist_;
+  bool                inverse_valid_ { false };
+
+  CXDitherType        dither_type_ { CX_DITHER_ERROR_DIFFUSION };
+  CXDitherPalette     dither_palette_;
+  bool                dither_valid_ { false };
 
   uint red_mask_ { 0 }, green_mask_ { 0 }, blue_mask_ { 0 }, alpha_mask_ { 0 };
   int  red_shift_ { 0 }, green_shift_ { 0 }, blue_shift_ { 0 }, alpha_shift_ { 0 };
 
-  WindowMap   window_map_;
-
   CXColorMgr *color_mgr_ { nullptr };
 };
 
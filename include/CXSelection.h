@@ -0,0 +1,172 @@
+#ifndef CX_SELECTION_H
+#define CX_SELECTION_H
+
+#include <std_Xt.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CXMachine;
+
+// converted selection value (32 bit items are stored as 4 byte CARD32s)
+struct CXSelectionData {
+  Atom        selection { None };
+  Atom        target    { None };
+  Atom        type      { None };
+  int         format    { 8 };
+  std::string data;
+  bool        valid     { false };
+  bool        timed_out { false };
+};
+
+typedef void (*CXSelectionProc)(const CXSelectionData &data, void *client_data);
+
+// ICCCM selection owner and requestor.
+//
+// Owned selections serve TARGETS, TIMESTAMP, the text targets (UTF8_STRING,
+// STRING, TEXT, text/plain;charset=utf-8) and any binary (e.g. MIME) target
+// added with setData. Data larger than a request is sent with INCR.
+//
+// Requests convert through a hidden window and complete asynchronously
+// from events (including INCR transfers) or a timeout. wait only handles
+// selection events so it never re-enters the application event loop
+class CXSelection {
+ public:
+  enum { DEFAULT_TIMEOUT = 5000 };
+
+ public:
+  CXSelection(CXMachine &machine);
+ ~CXSelection();
+
+  //--- owner
+
+  bool setText(Atom selection, Window xwin, const std::string &text, Time time=CurrentTime);
+
+  // add target data (takes ownership if not already owned by window)
+  bool setData(Atom selection, Window xwin, Atom target, const std::string &data,
+               Time time=CurrentTime);
+
+  void reset(Atom selection);
+
+  bool   isOwner (Atom selection) const;
+  Window getOwner(Atom selection) const;
+
+  //--- requestor
+
+  // request conversion of selection to target, proc is called on completion
+  // (immediately if we own the selection). Returns request id
+  uint request(Atom selection, Atom target, CXSelectionProc proc, void *client_data,
+               int timeout_msecs=DEFAULT_TIMEOUT);
+
+  void cancel(uint id);
+
+  bool isPending(uint id) const;
+
+  // wait for request to complete, handling only selection events
+  void wait(uint id);
+
+  // blocking text fetch (UTF8_STRING then STRING), result is UTF-8
+  bool getText(Atom selection, std::string &text, int timeout_msecs=DEFAULT_TIMEOUT);
+
+  //--- events (return true if handled)
+
+  bool selectionRequestEvent(const XSelectionRequestEvent *event);
+  bool selectionClearEvent  (const XSelectionClearEvent *event);
+  bool selectionNotifyEvent (const XSelectionEvent *event);
+  bool propertyNotifyEvent  (const XPropertyEvent *event);
+
+  bool isSelectionEvent(const XEvent *event) const;
+
+  //--- display
+
+  // destroy requestor window and drop owned selections, transfers and
+  // requests (called before display is closed or changed)
+  void resetDisplay();
+
+  //--- timeouts
+
+  // poll timeout (msecs, -1 is infinite) limited by next selection deadline
+  int getTimeout(int timeout_msecs) const;
+
+  void checkTimeouts();
+
+ private:
+  typedef std::shared_ptr<const std::string> DataP;
+
+  struct Target {
+    Atom  type   { None };
+    int   format { 8 };
+    DataP data;
+  };
+
+  typedef std::map<Atom, Target> Targets;
+
+  struct Owner {
+    Window  xwin { None };
+    Time    time { CurrentTime };
+    Targets targets;
+  };
+
+  typedef std::map<Atom, Owner> Owners;
+
+  struct IncrSend {
+    Window    requestor    { None };
+    Atom      property     { None };
+    Target    target;
+    size_t    pos          { 0 };
+    long long deadline     { 0 };
+    uint      restore_mask { 0 };
+    bool      restore      { false };
+  };
+
+  typedef std::vector<IncrSend> IncrSends;
+
+  struct Request {
+    uint            id          { 0 };
+    Atom            property    { None };
+    bool            incr        { false };
+    long long       deadline    { 0 };
+    int             timeout     { 0 };
+    CXSelectionProc proc        { nullptr };
+    void           *client_data { nullptr };
+    CXSelectionData result;
+  };
+
+  typedef std::vector<Request> Requests;
+
+ private:
+  CXSelection(const CXSelection &rhs);
+  CXSelection &operator=(const CXSelection &rhs);
+
+  Atom getAtom(const char *name) const;
+
+  Owner *takeOwnership(Atom selection, Window xwin, Time time);
+
+  bool getTarget(const Owner &owner, Atom target, Target &data) const;
+
+  bool sendTarget(Window requestor, Atom property, const Target &target);
+  bool sendIncrChunk(IncrSend &send);
+  void endIncrSend(size_t i);
+
+  Window getRequestorWindow();
+  Atom   getRequestProperty();
+
+  long readProperty(Window xwin, Atom property, CXSelectionData &result);
+
+  void completeRequest(size_t i, bool valid, bool timed_out=false);
+
+  void dispatchEvent(XEvent *event);
+
+  size_t getChunkSize() const;
+
+ private:
+  CXMachine &machine_;
+  Owners     owners_;
+  IncrSends  sends_;
+  Requests   requests_;
+  uint       request_id_     { 0 };
+  Window     requestor_xwin_ { None };
+};
+
+#endif
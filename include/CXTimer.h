@@ -15,6 +15,8 @@ class CXTimer {
 
   void restart();
 
+  static bool hasTimers();
+
  private:
   CXTimer1 *timer_ { nullptr };
 };
@@ -12,6 +12,14 @@ class CXUtil {
                                 int *screen_num);
 
   static std::string encodeXFontName(const std::string &name, CFontStyle style, int size);
+
+  static bool isHostLSBFirst();
+
+  static void swapRedBlue(uint *argb, int n);
+
+  static void blendARGB(uint *dst, const uint *src, int n);
+
+  static void premultiplyARGB(uint *argb, int n);
 };
 
 #endif
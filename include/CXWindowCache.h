@@ -0,0 +1,67 @@
+#ifndef CX_WINDOW_CACHE_H
+#define CX_WINDOW_CACHE_H
+
+#include <std_Xt.h>
+#include <string>
+#include <unordered_map>
+
+// Opt-in client side cache of window attributes, parent and WM properties.
+// Windows are only cached while this client selects StructureNotifyMask on
+// them (properties also need PropertyChangeMask) so the Configure, Gravity,
+// Map, Unmap, Reparent, Destroy and Property notify events received keep the
+// entries coherent
+class CXWindowCache {
+ public:
+  struct Entry {
+    XWindowAttributes attr;
+    bool              attr_valid   { false };
+    uint              map_serial   { 0 };
+    Window            parent       { None };
+    bool              parent_valid { false };
+    bool              properties   { false };
+    bool              name_valid   { false };
+    bool              has_name     { false };
+    std::string       name;
+    bool              icon_valid   { false };
+    bool              has_icon     { false };
+    std::string       icon_name;
+    bool              class_valid  { false };
+    bool              has_class    { false };
+    std::string       res_name;
+    std::string       res_class;
+  };
+
+ public:
+  CXWindowCache() { }
+
+  bool isEnabled() const { return enabled_; }
+  void setEnabled(bool enabled);
+
+  // entry for window (nullptr if not cached)
+  Entry *getEntry(Window xwin);
+
+  // cache attributes (returns nullptr if window events not selected)
+  Entry *setAttributes(Window xwin, const XWindowAttributes &attr);
+
+  // attributes are cached and, if needed, map state is current
+  bool isAttrValid(const Entry *entry, bool map_state) const;
+
+  void removeEntry(Window xwin);
+
+  void invalidateGeometry(Window xwin);
+  void invalidateProperty(Window xwin, Atom atom);
+  void invalidateMapState() { ++map_serial_; }
+
+  void processEvent(const XEvent &event);
+
+  void clear();
+
+ private:
+  typedef std::unordered_map<Window, Entry> EntryMap;
+
+  bool     enabled_    { false };
+  EntryMap entries_;
+  uint     map_serial_ { 1 };
+};
+
+#endif
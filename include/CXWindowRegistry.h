@@ -0,0 +1,39 @@
+#ifndef CX_WINDOW_REGISTRY_H
+#define CX_WINDOW_REGISTRY_H
+
+#include <std_Xt.h>
+#include <vector>
+
+class CXWindow;
+
+// XID -> CXWindow for windows of all screens. Open addressing hash (linear
+// probing, backward shift delete) with a last hit cache for event dispatch
+class CXWindowRegistry {
+ public:
+  CXWindowRegistry() { }
+
+  void addWindow(Window xwin, CXWindow *window);
+  void removeWindow(Window xwin, CXWindow *window);
+
+  CXWindow *lookupWindow(Window xwin) const;
+
+  uint getNumWindows() const { return num_; }
+
+ private:
+  uint findSlot(Window xwin) const;
+
+  void grow();
+
+ private:
+  struct Slot {
+    Window    xwin   { None };
+    CXWindow *window { nullptr };
+  };
+
+  std::vector<Slot> slots_;
+  uint              num_         { 0 };
+  mutable Window    last_xwin_   { None };
+  mutable CXWindow *last_window_ { nullptr };
+};
+
+#endif
@@ -2,20 +2,28 @@
 #define CXRT_FONT_H
 
 #include <std_Xt.h>
+#include <memory>
 #include <string>
+#include <vector>
 
 class CPixelRenderer;
+class CXrtFont;
+
+typedef std::shared_ptr<CXrtFont> CXrtFontP;
 
 class CXrtFont {
  public:
+  // shared font for (display, screen root, XLFD name, angle). Fonts are
+  // kept while referenced so all users share one font struct and atlas
+  static CXrtFontP lookup(Display *display, Window window, const std::string &name,
+                          double angle);
+
   CXrtFont(Display *display, XFontStruct *fs, double angle);
   CXrtFont(Display *display, const std::string &name, double angle);
 
   CXrtFont(Display *display, Window window, XFontStruct *fs, double angle);
   CXrtFont(Display *display, Window window, const std::string &name, double angle);
 
-  CXrtFont(const CXrtFont &xrt_font);
-
  ~CXrtFont();
 
   void getExtents(int *width, int *ascent, int *descent);
@@ -24,6 +32,11 @@ class CXrtFont {
 
   void textExtents(const std::string &str, int *width, int *ascent, int *descent);
 
+  // advance widths (same as XTextWidth) from table built at init
+  int getCharAdvance(unsigned char c) const;
+
+  int getStringWidth(const std::string &str) const;
+
   void draw(Window window, GC gc, int x, int y, const std::string &str);
 
   void drawImage(Window window, GC gc, int x, int y, const std::string &str);
@@ -35,31 +48,67 @@ class CXrtFont {
   XFontStruct *getFontStruct();
 
  private:
+  // glyph cell bitmap (1 bpp rows, LSB first, byte padded) rotated into its
+  // bounding box
+  struct Glyph {
+    bool                       valid  { false };
+    int                        width  { 0 };
+    int                        height { 0 };
+    int                        dx     { 0 }; // bitmap offset from pen position
+    int                        dy     { 0 };
+    int                        ax     { 0 }; // bitmap position in atlas pixmap
+    int                        ay     { 0 };
+    std::vector<unsigned char> bits;
+
+    bool getBit(int x, int y) const {
+      return (bits[size_t(y*((width + 7)/8) + x/8)] & (1 << (x & 7)));
+    }
+  };
+
+  typedef std::vector<Glyph> Glyphs;
+
+ private:
+  // not copyable (owns font struct, pixmaps and GC) : share with CXrtFontP
+  CXrtFont(const CXrtFont &xrt_font);
+  CXrtFont &operator=(const CXrtFont &xrt_font);
+
   void initFontStruct(const std::string &name);
 
   void init();
 
-  void rotateChar(int c);
+  void initAdvances();
+
+  bool rotateChars(const std::string &str);
+  void rotateGlyph(int c1, XImage *ximage, int x);
+
+  void getRotatedRect(int w, int h, int *x, int *y, int *rw, int *rh) const;
 
-  static int XErrorHandler(Display *display, XErrorEvent *event);
+  int getCharWidth(int c1) const;
 
  private:
-  Display     *display_ { nullptr };
-  Window       window_ { 0 };
-  int          angle_ { 0 };
+  Display     *display_      { nullptr };
+  Window       window_       { 0 };
+  int          angle_        { 0 };
+  double       cos_          { 1.0 };
+  double       sin_          { 0.0 };
   std::string  name_;
-  XFontStruct *fs_ { nullptr };
-  Pixmap       pixmap1_ { 0 };
-  Pixmap       pixmap2_ { 0 };
-  XImage      *ximage_ { nullptr };
-  GC           gc_ { 0 };
-  int          width_ { 8 };
-  int          ascent_ { 8 };
-  int          descent_ { 2 };
-  int          start_char_ { 0 };
-  int          end_char_ { 0 };
-  int          num_chars_ { 0 };
-  bool        *rotated_ { nullptr };
+  XFontStruct *fs_           { nullptr };
+  Pixmap       pixmap1_      { 0 };
+  Pixmap       pixmap2_      { 0 };
+  GC           gc_           { 0 };
+  int          width_        { 8 };
+  int          ascent_       { 8 };
+  int          descent_      { 2 };
+  int          start_char_   { 0 };
+  int          end_char_     { 0 };
+  int          num_chars_    { 0 };
+  int          atlas_cols_   { 1 };
+  int          atlas_width_  { 0 };
+  int          atlas_height_ { 0 };
+  Glyphs       glyphs_;
+  bool         advances_valid_ { false };
+  int          fixed_advance_  { -1 };
+  int          advances_[256];
 };
 
 #endif
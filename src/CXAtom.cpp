@@ -234,11 +234,10 @@ const CXAtom &
 CXAtomMgr::
 getCXAtom(const std::string &name)
 {
-  auto patom1 = atom_map_.find(name);
-  auto patom2 = atom_map_.end();
+  auto patom = name_map_.find(name);
 
-  if (patom1 != patom2)
-    return *((*patom1).second);
+  if (patom != name_map_.end())
+    return *(*patom).second;
 
   Display *display = machine_.getDisplay();
 
@@ -250,22 +249,98 @@ getCXAtom(const std::string &name)
 
   Atom xatom = XInternAtom(display, name.c_str(), False);
 
-  CXAtom *atom = new CXAtom(name, xatom);
-
-  atom_map_[name] = atom;
-
-  return *atom;
+  return addAtom(name, xatom);
 }
 
 const CXAtom &
 CXAtomMgr::
 getCXAtom(Atom atom)
 {
+  static CXAtom none_atom("", None);
+
+  if (atom == None)
+    return none_atom;
+
+  auto patom = atom_map_.find(atom);
+
+  if (patom != atom_map_.end())
+    return *(*patom).second;
+
+  // unknown atom : one round trip for its name
+  Display *display = machine_.getDisplay();
+
+  char *name = (display ? XGetAtomName(display, atom) : nullptr);
+
+  if (! name)
+    return none_atom;
+
+  std::string name1 = name;
+
+  XFree(name);
+
+  return addAtom(name1, atom);
+}
+
+// intern atoms used by the library in a single round trip
+void
+CXAtomMgr::
+preloadAtoms()
+{
+  static const char *atom_names[] = {
+    // ICCCM
+    "WM_PROTOCOLS", "WM_TAKE_FOCUS", "WM_SAVE_YOURSELF", "WM_DELETE_WINDOW",
+    "WM_STATE", "WM_CHANGE_STATE", "WM_CLASS", "WM_CLIENT_MACHINE",
+    "CLIPBOARD", "TARGETS", "MULTIPLE", "TIMESTAMP", "INCR", "UTF8_STRING", "TEXT",
+    "COMPOUND_TEXT",
+    // EWMH
+    "_NET_WM_NAME", "_NET_WM_ICON_NAME", "_NET_WM_STATE", "_NET_WM_MOVERESIZE",
+    "_NET_SUPPORTING_WM_CHECK", "_NET_SHOWING_DESKTOP", "_NET_RESTACK_WINDOW",
+    "_NET_MOVERESIZE_WINDOW", "_NET_CLOSE_WINDOW", "_NET_ACTIVE_WINDOW",
+    // Motif/other window managers
+    "_MOTIF_WM_HINTS", "_XSETROOT_ID", "CWM_DESKTOP",
+    // library messages
+    "WINDOW_MESSAGE", "CLIENT_WINDOW", "CLIENT_MESSAGE", "SERVER_WINDOW", "SERVER_MESSAGE",
+  };
+
   Display *display = machine_.getDisplay();
 
-  char *name = XGetAtomName(display, atom);
+  if (! display)
+    return;
 
-  return getCXAtom(name);
+  std::vector<char *> names;
+
+  for (const auto &atom_name : atom_names) {
+    if (name_map_.find(atom_name) == name_map_.end())
+      names.push_back(const_cast<char *>(atom_name));
+  }
+
+  if (names.empty())
+    return;
+
+  std::vector<Atom> xatoms(names.size());
+
+  if (! XInternAtoms(display, &names[0], int(names.size()), False, &xatoms[0]))
+    return;
+
+  for (size_t i = 0; i < names.size(); ++i)
+    addAtom(names[i], xatoms[i]);
+}
+
+// add atom to name and id tables
+const CXAtom &
+CXAtomMgr::
+addAtom(const std::string &name, Atom xatom)
+{
+  atoms_.emplace_back(name, xatom);
+
+  CXAtom *atom = &atoms_.back();
+
+  name_map_[name] = atom;
+
+  if (xatom != None)
+    atom_map_.emplace(xatom, atom);
+
+  return *atom;
 }
 
 //---
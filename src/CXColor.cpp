@@ -2,6 +2,9 @@
 #include <CXMachine.h>
 #include <CXScreen.h>
 
+static uint packRGBA(const CRGBA &rgba);
+static uint hashKey(uint key);
+
 CXColorMgr::
 CXColorMgr() :
  screen_(*CXMachineInst->getCXScreen(0))
@@ -17,11 +20,6 @@ CXColorMgr(CXScreen &screen) :
 CXColorMgr::
 ~CXColorMgr()
 {
-  CXColorMap::iterator pcolor1 = colormap_.begin();
-  CXColorMap::iterator pcolor2 = colormap_.end();
-
-  for ( ; pcolor1 != pcolor2; ++pcolor1)
-    delete (*pcolor1).second;
 }
 
 const CXColor &
@@ -37,38 +35,132 @@ const CXColor &
 CXColorMgr::
 getCXColor(const CRGBA &rgba)
 {
-  Pixel pixel = screen_.rgbaToPixel(rgba);
+  uint key = packRGBA(rgba);
+
+  CacheEntry &entry = cache_[hashKey(key) & (CACHE_SIZE - 1)];
+
+  if (entry.color && entry.key == key)
+    return *entry.color;
 
-  CXColorMap::iterator pcolor1 = colormap_.find(pixel);
-  CXColorMap::iterator pcolor2 = colormap_.end();
+  uint ind = rgba_index_.find(key);
 
-  if (pcolor1 != pcolor2)
-    return *(*pcolor1).second;
+  if (ind == 0) {
+    Pixel pixel = screen_.rgbaToPixel(rgba);
 
-  CXColor *color = new CXColor(screen_, rgba, pixel);
+    colors_.emplace_back(screen_, rgba, pixel);
 
-  colormap_[pixel] = color;
+    ind = uint(colors_.size());
 
-  return *color;
+    rgba_index_.insert(key, ind);
+  }
+
+  entry.key   = key;
+  entry.color = &colors_[ind - 1];
+
+  return *entry.color;
 }
 
 const CXColor &
 CXColorMgr::
 getCXColor(Pixel pixel)
 {
-  CXColorMap::iterator pcolor1 = colormap_.find(pixel);
-  CXColorMap::iterator pcolor2 = colormap_.end();
+  uint key = uint(pixel);
+
+  uint ind = pixel_index_.find(key);
+
+  if (ind == 0) {
+    colors_.emplace_back(screen_, pixel);
+
+    ind = uint(colors_.size());
+
+    pixel_index_.insert(key, ind);
+  }
+
+  return colors_[ind - 1];
+}
+
+void
+CXColorMgr::
+clearIndex()
+{
+  rgba_index_ .clear();
+  pixel_index_.clear();
+
+  for (auto &entry : cache_)
+    entry = CacheEntry();
+}
+
+uint
+CXColorMgr::IndexHash::
+find(uint key) const
+{
+  if (slots_.empty())
+    return 0;
+
+  uint mask = uint(slots_.size() - 1);
+
+  for (uint i = hashKey(key) & mask; ; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+
+    if (slot.ind == 0)
+      return 0;
+
+    if (slot.key == key)
+      return slot.ind;
+  }
+}
+
+void
+CXColorMgr::IndexHash::
+insert(uint key, uint ind)
+{
+  // keep load factor at most 1/2
+  if (2*(num_ + 1) > slots_.size())
+    grow();
+
+  uint mask = uint(slots_.size() - 1);
+
+  uint i = hashKey(key) & mask;
 
-  if (pcolor1 != pcolor2)
-    return *(*pcolor1).second;
+  while (slots_[i].ind != 0 && slots_[i].key != key)
+    i = (i + 1) & mask;
 
-  CXColor *color = new CXColor(screen_, pixel);
+  if (slots_[i].ind == 0)
+    ++num_;
 
-  colormap_[pixel] = color;
+  slots_[i].key = key;
+  slots_[i].ind = ind;
+}
+
+void
+CXColorMgr::IndexHash::
+clear()
+{
+  slots_.clear();
 
-  return *color;
+  num_ = 0;
 }
 
+void
+CXColorMgr::IndexHash::
+grow()
+{
+  std::vector<Slot> slots;
+
+  slots.swap(slots_);
+
+  slots_.resize(std::max(size_t(64), 2*slots.size()));
+
+  num_ = 0;
+
+  for (const auto &slot : slots) {
+    if (slot.ind != 0)
+      insert(slot.key, slot.ind);
+  }
+}
+
+//------
+
 CXColor::
 CXColor() :
  screen_(*CXMachineInst->getCXScreen(0))
@@ -270,3 +362,29 @@ getInversePixel() const
 
   return inverse_color_->getPixel();
 }
+
+//------
+
+// 8 bit components truncated as in CXScreen::rgbaToPixel
+static uint
+packRGBA(const CRGBA &rgba)
+{
+  double r, g, b, a;
+
+  rgba.getRGBA(&r, &g, &b, &a);
+
+  auto toByte = [](double x) { return uint(std::min(std::max(x, 0.0), 1.0)*255) & 0xFF; };
+
+  return (toByte(a) << 24) | (toByte(r) << 16) | (toByte(g) << 8) | toByte(b);
+}
+
+// mix all key bits into low bits (murmur3 finalizer)
+static uint
+hashKey(uint key)
+{
+  key ^= key >> 16; key *= 0x85EBCA6Bu;
+  key ^= key >> 13; key *= 0xC2B2AE35u;
+  key ^= key >> 16;
+
+  return key;
+}
@@ -2,8 +2,9 @@
 #include <CXMachine.h>
 #include <CXScreen.h>
 #include <CXImage.h>
-#include <CXrtFont.h>
+#include <CXFontDatabase.h>
 #include <CFontMgr.h>
+#include <algorithm>
 
 void
 CXFont::
@@ -66,11 +67,10 @@ CXFont(CXScreen &screen, XFontStruct *fs, uint angle) :
 
 CXFont::
 CXFont(const CXFont &font) :
- CFont(font), screen_(font.screen_), font_family_(font.font_family_),
+ CFont(font), screen_(font.screen_), font_family_(font.font_family_), xrt_font_(font.xrt_font_),
  font_width_(font.font_width_), font_ascent_(font.font_ascent_), font_descent_(font.font_descent_),
  proportional_(font.proportional_), font_aspect_(font.font_aspect_)
 {
-  xrt_font_ = new CXrtFont(*font.xrt_font_);
 }
 
 CXFont::
@@ -84,7 +84,6 @@ CXFont(const CFont &font) :
 CXFont::
 ~CXFont()
 {
-  delete xrt_font_;
 }
 
 CXFont &
@@ -99,7 +98,7 @@ operator=(const CXFont &font)
   proportional_ = font.proportional_;
   font_aspect_  = font.font_aspect_;
 
-  xrt_font_ = new CXrtFont(*font.xrt_font_);
+  xrt_font_ = font.xrt_font_;
 
   return *this;
 }
@@ -124,7 +123,8 @@ init()
   Display *display = screen_.getDisplay();
   Window   root    = screen_.getRoot();
 
-  xrt_font_ = new CXrtFont(display, root, x_font_name, getIAngle());
+  // identical fonts share one loaded font and glyph atlas
+  xrt_font_ = CXrtFont::lookup(display, root, x_font_name, getIAngle());
 
   int font_width, font_ascent, font_descent;
 
@@ -146,7 +146,8 @@ init(XFontStruct *fs)
   Display *display = screen_.getDisplay();
   Window   root    = screen_.getRoot();
 
-  xrt_font_ = new CXrtFont(display, root, fs, getIAngle());
+  // font struct is owned by this font so it is not shared
+  xrt_font_ = CXrtFontP(new CXrtFont(display, root, fs, getIAngle()));
 
   int font_width, font_ascent, font_descent;
 
@@ -167,11 +168,69 @@ uint
 CXFont::
 getIStringWidth(const std::string &str) const
 {
-  int width;
+  return uint(xrt_font_->getStringWidth(str));
+}
+
+void
+CXFont::
+getStringWidths(const std::vector<std::string> &strs, std::vector<uint> &widths) const
+{
+  auto n = strs.size();
+
+  widths.resize(n);
+
+  for (size_t i = 0; i < n; i++)
+    widths[i] = uint(xrt_font_->getStringWidth(strs[i]));
+}
+
+void
+CXFont::
+getPrefixWidths(const std::string &str, std::vector<uint> &widths) const
+{
+  auto len = str.size();
+
+  widths.resize(len + 1);
+
+  int width = 0;
 
-  xrt_font_->textExtents(str, &width, nullptr, nullptr);
+  widths[0] = 0;
 
-  return uint(width);
+  for (size_t i = 0; i < len; i++) {
+    width += xrt_font_->getCharAdvance(uchar(str[i]));
+
+    widths[i + 1] = uint(std::max(width, 0));
+  }
+}
+
+uint
+CXFont::
+getFitLength(const std::string &str, uint width) const
+{
+  auto len = str.size();
+
+  int width1 = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    width1 += xrt_font_->getCharAdvance(uchar(str[i]));
+
+    if (width1 > int(width))
+      return uint(i);
+  }
+
+  return uint(len);
+}
+
+uint
+CXFont::
+getFitLength(const std::vector<uint> &widths, uint width)
+{
+  if (widths.empty())
+    return 0;
+
+  // first prefix wider than width (prefix widths are non decreasing)
+  auto p = std::upper_bound(widths.begin(), widths.end(), width);
+
+  return uint(p - widths.begin()) - 1;
 }
 
 CImagePtr
@@ -208,33 +267,29 @@ getStringImage(const std::string &str)
 
 //-------------------
 
-#define ALL_FONTS "-*-*-*-*-*-*-*-*-*-*-*-*-*-*"
-
+// register server fonts with font families (fonts are listed and decoded
+// once by the font database, or read from its cache file)
 void
 CXFont::
 loadFontDatabase()
 {
-  CXFontList font_list;
+  CXFontDatabase *database = CXFontDatabaseInst;
 
-  uint num_fonts = font_list.getNumFonts();
+  if (! database->load())
+    return;
 
-  std::string family;
-  CFontStyle  style;
-  uint        size, x_res, y_res;
+  uint num_fonts = database->getNumFonts();
 
   for (uint i = 0; i < num_fonts; i++) {
-    const char *font_name = font_list.getFont(i);
-
-    if (! decodeXFontName(font_name, family, style, size, x_res, y_res))
-      continue;
+    const CXFontDatabase::Font &font = database->getFont(i);
 
-    CFontFamily &font_family = CFontFamily::lookup(family);
+    CFontFamily &font_family = CFontFamily::lookup(font.family);
 
-    CFontDef &font = font_family.lookupFontDef(style, size);
+    CFontDef &font_def = font_family.lookupFontDef(font.style, font.size);
 
-    if (x_res > font.x_res || y_res > font.y_res) {
-      font.x_res = x_res;
-      font.y_res = y_res;
+    if (font.x_res > font_def.x_res || font.y_res > font_def.y_res) {
+      font_def.x_res = font.x_res;
+      font_def.y_res = font.y_res;
     }
   }
 }
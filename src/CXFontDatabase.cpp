@@ -0,0 +1,370 @@
+#include <CXFontDatabase.h>
+#include <CXMachine.h>
+#include <CFont.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CX_FONT_DATABASE_VERSION "CXFontDatabase 2"
+
+static long getPathTime(const std::string &path);
+
+CXFontDatabase *
+CXFontDatabase::
+getInstance()
+{
+  static CXFontDatabase *instance_;
+
+  if (! instance_)
+    instance_ = new CXFontDatabase();
+
+  return instance_;
+}
+
+CXFontDatabase::
+CXFontDatabase()
+{
+  const char *file = getenv("CX_LIB_FONT_CACHE");
+
+  if (file)
+    cache_file_ = file;
+}
+
+bool
+CXFontDatabase::
+load()
+{
+  if (loaded_)
+    return true;
+
+  return loadFonts(true);
+}
+
+bool
+CXFontDatabase::
+reload()
+{
+  clear();
+
+  return loadFonts(false);
+}
+
+bool
+CXFontDatabase::
+loadFonts(bool use_cache)
+{
+  Display *display = CXMachineInst->getDisplay();
+
+  if (! display)
+    return false;
+
+  std::vector<std::string> key;
+
+  getServerKey(display, key);
+
+  if (! use_cache || cache_file_ == "" || ! readCache(key)) {
+    clear();
+
+    CXFontList font_list;
+
+    uint num_fonts = font_list.getNumFonts();
+
+    fonts_.reserve(num_fonts);
+
+    for (uint i = 0; i < num_fonts; i++) {
+      Font font;
+
+      font.name = font_list.getFont(i);
+
+      if (! CFont::decodeXFontName(font.name, font.family, font.style,
+                                   font.size, font.x_res, font.y_res))
+        continue;
+
+      fonts_.push_back(font);
+    }
+
+    if (cache_file_ != "" && ! fonts_.empty())
+      writeCache(key);
+  }
+
+  buildIndex();
+
+  loaded_ = true;
+
+  return true;
+}
+
+void
+CXFontDatabase::
+clear()
+{
+  fonts_.clear();
+  index_.clear();
+
+  loaded_ = false;
+}
+
+void
+CXFontDatabase::
+getFamilies(std::vector<std::string> &families) const
+{
+  families.clear();
+
+  for (const auto &pi : index_) {
+    if (families.empty() || families.back() != pi.first.first)
+      families.push_back(pi.first.first);
+  }
+}
+
+void
+CXFontDatabase::
+getFonts(const std::string &family, CFontStyle style, std::vector<const Font *> &fonts) const
+{
+  fonts.clear();
+
+  const std::vector<uint> *index = getIndex(family, style);
+
+  if (! index)
+    return;
+
+  for (auto i : *index)
+    fonts.push_back(&fonts_[i]);
+}
+
+const CXFontDatabase::Font *
+CXFontDatabase::
+lookup(const std::string &family, CFontStyle style, uint size) const
+{
+  const std::vector<uint> *index = getIndex(family, style);
+
+  if (! index)
+    return nullptr;
+
+  auto p = lowerBound(*index, size);
+
+  if (p == index->end() || fonts_[*p].size != size)
+    return nullptr;
+
+  return &fonts_[*p];
+}
+
+const CXFontDatabase::Font *
+CXFontDatabase::
+lookupNearest(const std::string &family, CFontStyle style, uint size) const
+{
+  const std::vector<uint> *index = getIndex(family, style);
+
+  if (! index || index->empty())
+    return nullptr;
+
+  auto p = lowerBound(*index, size);
+
+  if (p != index->end() && fonts_[*p].size == size)
+    return &fonts_[*p];
+
+  // scalable fonts (size 0) sort first and match any size
+  if (fonts_[index->front()].size == 0)
+    return &fonts_[index->front()];
+
+  if (p == index->end())
+    return &fonts_[*lowerBound(*index, fonts_[index->back()].size)];
+
+  if (p == index->begin())
+    return &fonts_[*p];
+
+  // compare with first (best resolution) font of next smaller size
+  uint size1 = fonts_[*(p - 1)].size;
+
+  if (size - size1 <= fonts_[*p].size - size)
+    return &fonts_[*lowerBound(*index, size1)];
+
+  return &fonts_[*p];
+}
+
+// server identity and font path with modification times of local font
+// directories (cache is valid while these match)
+void
+CXFontDatabase::
+getServerKey(Display *display, std::vector<std::string> &key) const
+{
+  key.clear();
+
+  key.push_back(CX_FONT_DATABASE_VERSION);
+
+  key.push_back(std::string(ServerVendor(display)) + " " +
+                std::to_string(VendorRelease(display)));
+
+  int    num_paths = 0;
+  char **paths     = XGetFontPath(display, &num_paths);
+
+  key.push_back(std::to_string(num_paths));
+
+  for (int i = 0; i < num_paths; i++)
+    key.push_back(std::string(paths[i]) + "\t" + std::to_string(getPathTime(paths[i])));
+
+  if (paths)
+    XFreeFontPath(paths);
+}
+
+// cache file : key lines, font count, then one tab separated line per font
+bool
+CXFontDatabase::
+readCache(const std::vector<std::string> &key)
+{
+  std::ifstream is(cache_file_.c_str());
+
+  if (! is)
+    return false;
+
+  std::string line;
+
+  for (const auto &key_line : key) {
+    if (! std::getline(is, line) || line != key_line)
+      return false;
+  }
+
+  if (! std::getline(is, line))
+    return false;
+
+  // count not trusted for reserve (file may be corrupt)
+  ulong num_fonts = strtoul(line.c_str(), nullptr, 10);
+
+  clear();
+
+  for (ulong i = 0; i < num_fonts; i++) {
+    if (! std::getline(is, line))
+      break;
+
+    char family[256], name[1024];
+    int  style;
+
+    Font font;
+
+    if (sscanf(line.c_str(), "%255[^\t]\t%d\t%u\t%u\t%u\t%1023[^\n]", family, &style,
+               &font.size, &font.x_res, &font.y_res, name) != 6)
+      break;
+
+    font.family = family;
+    font.style  = CFontStyle(style);
+    font.name   = name;
+
+    fonts_.push_back(font);
+  }
+
+  if (fonts_.size() != num_fonts) {
+    clear();
+    return false;
+  }
+
+  return true;
+}
+
+// write to temporary file (unique per process) and rename so readers never
+// see partial file
+bool
+CXFontDatabase::
+writeCache(const std::vector<std::string> &key) const
+{
+  std::string tmp_file = cache_file_ + "." + std::to_string(getpid()) + ".tmp";
+
+  std::ofstream os(tmp_file.c_str());
+
+  if (! os)
+    return false;
+
+  for (const auto &key_line : key)
+    os << key_line << "\n";
+
+  os << fonts_.size() << "\n";
+
+  for (const auto &font : fonts_)
+    os << font.family << "\t" << int(font.style) << "\t" << font.size << "\t" <<
+          font.x_res << "\t" << font.y_res << "\t" << font.name << "\n";
+
+  os.close();
+
+  if (! os) {
+    remove(tmp_file.c_str());
+    return false;
+  }
+
+  return (rename(tmp_file.c_str(), cache_file_.c_str()) == 0);
+}
+
+// index fonts by family and style, sorted by size then best resolution
+void
+CXFontDatabase::
+buildIndex()
+{
+  index_.clear();
+
+  uint num_fonts = uint(fonts_.size());
+
+  for (uint i = 0; i < num_fonts; i++)
+    index_[FamilyStyle(fonts_[i].family, int(fonts_[i].style))].push_back(i);
+
+  for (auto &pi : index_) {
+    std::stable_sort(pi.second.begin(), pi.second.end(), [&](uint i1, uint i2) {
+      const Font &font1 = fonts_[i1];
+      const Font &font2 = fonts_[i2];
+
+      if (font1.size != font2.size)
+        return (font1.size < font2.size);
+
+      return (font1.x_res + font1.y_res > font2.x_res + font2.y_res);
+    });
+  }
+}
+
+const std::vector<uint> *
+CXFontDatabase::
+getIndex(const std::string &family, CFontStyle style) const
+{
+  Index::const_iterator p = index_.find(FamilyStyle(family, int(style)));
+
+  if (p == index_.end())
+    return nullptr;
+
+  return &(*p).second;
+}
+
+// first font of index with size >= specified size
+std::vector<uint>::const_iterator
+CXFontDatabase::
+lowerBound(const std::vector<uint> &index, uint size) const
+{
+  return std::lower_bound(index.begin(), index.end(), size, [&](uint i, uint size1) {
+    return (fonts_[i].size < size1);
+  });
+}
+
+//------
+
+// latest modification time of local font directory and its fonts.dir
+// (0 for font server or missing path)
+static long
+getPathTime(const std::string &path)
+{
+  std::string dir = path;
+
+  if (dir.compare(0, 10, "catalogue:") == 0)
+    dir = dir.substr(10);
+
+  if (dir.empty() || dir[0] != '/')
+    return 0;
+
+  long mtime = 0;
+
+  struct stat st;
+
+  if (stat(dir.c_str(), &st) == 0)
+    mtime = long(st.st_mtime);
+
+  if (stat((dir + "/fonts.dir").c_str(), &st) == 0)
+    mtime = std::max(mtime, long(st.st_mtime));
+
+  return mtime;
+}
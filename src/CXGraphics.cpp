@@ -5,11 +5,20 @@
 #include <CXPixmap.h>
 #include <CXFont.h>
 #include <CXrtFont.h>
+#include <CXUtil.h>
 #include <CFontMgr.h>
 #include <CThrow.h>
+#include <algorithm>
+#include <cmath>
 
-bool   CXGraphics::error_trapped = false;
-XPoint CXGraphics::poly_point[];
+// X protocol coordinates are 16 bit
+static const int MIN_COORD = -32768;
+static const int MAX_COORD =  32767;
+
+static short clampCoord(int c);
+static bool  isCoordInRange(int c);
+static bool  clipSegment(double &x1, double &y1, double &x2, double &y2);
+static void  clipPolygon(std::vector<XPointDouble> &points);
 
 CXGraphics::
 CXGraphics(Window window) :
@@ -28,6 +37,13 @@ CXGraphics(CXScreen &screen, Window window) :
 CXGraphics::
 ~CXGraphics()
 {
+  flushDraw();
+
+  resetRenderPicture();
+
+  if (fill_picture_ != None)
+    CXMachineInst->freePicture(fill_picture_);
+
   CXMachineInst->freeGC(gc_);
 }
 
@@ -65,6 +81,8 @@ startDoubleBuffer(bool clear)
   if (in_double_buffer_)
     return;
 
+  flushDraw();
+
   int width, height;
 
   getSize(&width, &height);
@@ -80,6 +98,9 @@ startDoubleBuffer(bool clear)
     update = pixmap_->resizePixmap(uint(width), uint(height));
 
   if (update) {
+    // pixmap id may be reused by resized pixmap
+    resetRenderPicture();
+
     CXMachineInst->flushEvents(true);
 
     clear = true;
@@ -107,6 +128,8 @@ void
 CXGraphics::
 copyDoubleBuffer()
 {
+  flushDraw();
+
   if (! pixmap_)
     return;
 
@@ -120,15 +143,21 @@ void
 CXGraphics::
 setXor()
 {
+  flushDraw();
+
   CXMachineInst->freeGC(gc_);
 
   gc_ = CXMachineInst->createXorGC(screen_.getRoot(), fg_, bg_);
+
+  is_xor_ = true;
 }
 
 void
 CXGraphics::
 clear(bool redraw)
 {
+  flushDraw();
+
   CXMachineInst->setForeground(gc_, bg_);
 
   if (! is_pixmap_) {
@@ -172,17 +201,14 @@ fill()
 
   getSize(&width, &height);
 
-  if (pixmap_)
-    CXMachineInst->fillRectangle(pixmap_->getPixmap(), gc_, 0, 0, width, height);
-  else
-    CXMachineInst->fillRectangle(window_, gc_, 0, 0, width, height);
+  fillRectangle(0, 0, width, height);
 }
 
 void
 CXGraphics::
 setForeground(const CRGB &rgb)
 {
-  setForeground(CXColor(screen_, rgb));
+  setForeground(screen_.getCXColor(rgb));
 }
 
 void
@@ -193,7 +219,7 @@ setForeground(const CRGBA &rgba)
   if (fg_.getRGBA() == rgba)
     return;
 
-  setForeground(CXColor(screen_, rgba));
+  setForeground(screen_.getCXColor(rgba));
 }
 
 void
@@ -207,6 +233,10 @@ void
 CXGraphics::
 setForeground(const CXColor &color)
 {
+  // unsorted batches keep drawing order so draw them before color changes
+  if (! batch_sort_ && batch_size_ > 0 && color.getPixel() != fg_.getPixel())
+    flushDraw();
+
   fg_ = color;
 
   CXMachineInst->setForeground(gc_, fg_.getPixel());
@@ -216,14 +246,14 @@ void
 CXGraphics::
 setBackground(const CRGB &rgb)
 {
-  setBackground(CXColor(screen_, rgb));
+  setBackground(screen_.getCXColor(rgb));
 }
 
 void
 CXGraphics::
 setBackground(const CRGBA &rgba)
 {
-  setBackground(CXColor(screen_, rgba));
+  setBackground(screen_.getCXColor(rgba));
 }
 
 void
@@ -298,30 +328,60 @@ void
 CXGraphics::
 drawLine(int x1, int y1, int x2, int y2)
 {
-  if (pixmap_)
-    CXMachineInst->drawLine(pixmap_->getPixmap(), gc_, x1, y1, x2, y2);
+  DrawBatch *batch = getDrawBatch();
+
+  if (batch) {
+    XSegment segment;
+
+    segment.x1 = clampCoord(x1);
+    segment.y1 = clampCoord(y1);
+    segment.x2 = clampCoord(x2);
+    segment.y2 = clampCoord(y2);
+
+    batch->segments.push_back(segment);
+  }
   else
-    CXMachineInst->drawLine(window_, gc_, x1, y1, x2, y2);
+    CXMachineInst->drawLine(getDrawable(), gc_, x1, y1, x2, y2);
 }
 
 void
 CXGraphics::
 drawRectangle(int x, int y, int width, int height)
 {
-  if (pixmap_)
-    CXMachineInst->drawRectangle(pixmap_->getPixmap(), gc_, x, y, width, height);
+  DrawBatch *batch = getDrawBatch();
+
+  if (batch) {
+    XRectangle rect;
+
+    rect.x      = clampCoord(x);
+    rect.y      = clampCoord(y);
+    rect.width  = ushort(std::max(std::min(width , 0xFFFF), 0));
+    rect.height = ushort(std::max(std::min(height, 0xFFFF), 0));
+
+    batch->rects.push_back(rect);
+  }
   else
-    CXMachineInst->drawRectangle(window_, gc_, x, y, width, height);
+    CXMachineInst->drawRectangle(getDrawable(), gc_, x, y, width, height);
 }
 
 void
 CXGraphics::
 fillRectangle(int x, int y, int width, int height)
 {
-  if (pixmap_)
-    CXMachineInst->fillRectangle(pixmap_->getPixmap(), gc_, x, y, width, height);
+  DrawBatch *batch = getDrawBatch();
+
+  if (batch) {
+    XRectangle rect;
+
+    rect.x      = clampCoord(x);
+    rect.y      = clampCoord(y);
+    rect.width  = ushort(std::max(std::min(width , 0xFFFF), 0));
+    rect.height = ushort(std::max(std::min(height, 0xFFFF), 0));
+
+    batch->fill_rects.push_back(rect);
+  }
   else
-    CXMachineInst->fillRectangle(window_, gc_, x, y, width, height);
+    CXMachineInst->fillRectangle(getDrawable(), gc_, x, y, width, height);
 }
 
 void
@@ -331,137 +391,325 @@ drawPolygon(int *x, int *y, int num_xy)
   if (num_xy < 3)
     return;
 
-  if (num_xy > MAX_POLY_POINTS) {
-    CTHROW("Too many points in Polygon");
+  PolySource source;
+
+  source.x   = x;
+  source.y   = y;
+  source.num = uint(num_xy);
+
+  drawPolySource(source);
+}
+
+void
+CXGraphics::
+fillPolygon(int *x, int *y, int num_xy)
+{
+  if (num_xy < 3)
     return;
+
+  PolySource source;
+
+  source.x   = x;
+  source.y   = y;
+  source.num = uint(num_xy);
+
+  fillPolySource(source);
+}
+
+void
+CXGraphics::
+drawPolygon(const CIPoint2D *points, uint num_points)
+{
+  PolySource source;
+
+  source.points = points;
+  source.num    = num_points;
+
+  drawPolySource(source);
+}
+
+void
+CXGraphics::
+fillPolygon(const CIPoint2D *points, uint num_points)
+{
+  PolySource source;
+
+  source.points = points;
+  source.num    = num_points;
+
+  fillPolySource(source);
+}
+
+void
+CXGraphics::
+drawPolygon(const std::vector<CIPoint2D> &points)
+{
+  if (! points.empty())
+    drawPolygon(&points[0], uint(points.size()));
+}
+
+void
+CXGraphics::
+fillPolygon(const std::vector<CIPoint2D> &points)
+{
+  if (! points.empty())
+    fillPolygon(&points[0], uint(points.size()));
+}
+
+// draw polyline as runs of connected points (a run is broken where a
+// segment leaves the coordinate range)
+void
+CXGraphics::
+drawPolySource(const PolySource &source)
+{
+  if (source.num < 2)
+    return;
+
+  flushDraw();
+
+  poly_points_.clear();
+
+  for (uint i = 1; i < source.num; ++i) {
+    double x1 = source.getX(i - 1), y1 = source.getY(i - 1);
+    double x2 = source.getX(i    ), y2 = source.getY(i    );
+
+    if (! clipSegment(x1, y1, x2, y2)) {
+      drawPolyRun();
+      continue;
+    }
+
+    XPoint p1, p2;
+
+    p1.x = short(std::lround(x1)); p1.y = short(std::lround(y1));
+    p2.x = short(std::lround(x2)); p2.y = short(std::lround(y2));
+
+    if (poly_points_.empty() ||
+        poly_points_.back().x != p1.x || poly_points_.back().y != p1.y) {
+      drawPolyRun();
+
+      poly_points_.push_back(p1);
+    }
+
+    poly_points_.push_back(p2);
   }
 
-  for (int i = 0; i < num_xy; ++i) {
-    poly_point[uint(i)].x = short(x[uint(i)]);
-    poly_point[uint(i)].y = short(y[uint(i)]);
+  drawPolyRun();
+}
+
+// draw and clear current run, split into request sized chunks which share
+// their end points so the line stays connected
+void
+CXGraphics::
+drawPolyRun()
+{
+  uint num_points = uint(poly_points_.size());
+
+  if (num_points >= 2) {
+    Drawable drawable = getDrawable();
+
+    uint max_points = getMaxRequestPoints(3);
+
+    for (uint i = 0; i < num_points - 1; i += max_points - 1) {
+      uint n = std::min(max_points, num_points - i);
+
+      XDrawLines(display_, drawable, gc_, &poly_points_[i], int(n), CoordModeOrigin);
+    }
   }
 
-  if (pixmap_)
-    XDrawLines(display_, pixmap_->getPixmap(), gc_, poly_point, num_xy, CoordModeOrigin);
-  else
-    XDrawLines(display_, window_, gc_, poly_point, num_xy, CoordModeOrigin);
+  poly_points_.clear();
 }
 
 void
 CXGraphics::
-fillPolygon(int *x, int *y, int num_xy)
+fillPolySource(const PolySource &source)
 {
-  if (num_xy < 3)
+  if (source.num < 3)
     return;
 
-  if (num_xy > MAX_POLY_POINTS) {
+  flushDraw();
+
+  bool in_range = true;
+
+  for (uint i = 0; i < source.num; ++i) {
+    if (! isCoordInRange(source.getX(i)) || ! isCoordInRange(source.getY(i))) {
+      in_range = false;
+      break;
+    }
+  }
+
+  bool render = useRender();
+
+  if (render || ! in_range) {
+    poly_dpoints_.resize(source.num);
+
+    for (uint i = 0; i < source.num; ++i) {
+      poly_dpoints_[i].x = source.getX(i);
+      poly_dpoints_[i].y = source.getY(i);
+    }
+
+    if (! in_range)
+      clipPolygon(poly_dpoints_);
+
+    if (poly_dpoints_.size() < 3)
+      return;
+
+    if (render && fillRenderPolygon(poly_dpoints_))
+      return;
+
+    poly_points_.resize(poly_dpoints_.size());
+
+    for (uint i = 0; i < poly_points_.size(); ++i) {
+      poly_points_[i].x = short(std::lround(poly_dpoints_[i].x));
+      poly_points_[i].y = short(std::lround(poly_dpoints_[i].y));
+    }
+  }
+  else {
+    poly_points_.resize(source.num);
+
+    for (uint i = 0; i < source.num; ++i) {
+      poly_points_[i].x = short(source.getX(i));
+      poly_points_[i].y = short(source.getY(i));
+    }
+  }
+
+  // a filled polygon can not be split across requests
+  if (poly_points_.size() > getMaxRequestPoints(4)) {
     CTHROW("Too many points in Polygon");
     return;
   }
 
-  for (int i = 0; i < num_xy; ++i) {
-    poly_point[uint(i)].x = short(x[uint(i)]);
-    poly_point[uint(i)].y = short(y[uint(i)]);
-  }
+  XFillPolygon(display_, getDrawable(), gc_, &poly_points_[0], int(poly_points_.size()),
+               fill_complex_ ? Complex : Convex, CoordModeOrigin);
+}
 
-  if (pixmap_)
-    XFillPolygon(display_, pixmap_->getPixmap(), gc_, poly_point, num_xy,
-                 fill_complex_ ? Complex : Convex, CoordModeOrigin);
-  else
-    XFillPolygon(display_, window_, gc_, poly_point, num_xy,
-                 fill_complex_ ? Complex : Convex, CoordModeOrigin);
+// max points (one request unit each) after request header of specified size
+uint
+CXGraphics::
+getMaxRequestPoints(uint header_size) const
+{
+  long max_size = XExtendedMaxRequestSize(display_);
+
+  if (max_size <= 0)
+    max_size = XMaxRequestSize(display_);
+
+  return uint(max_size - long(header_size));
 }
 
 void
 CXGraphics::
 drawCircle(int x, int y, int r)
 {
-  if (pixmap_)
-    XDrawArc(display_, pixmap_->getPixmap(), gc_, short(x - r), short(y - r),
-             uint(2*r), uint(2*r), 0, 360*64);
-  else
-    XDrawArc(display_, window_, gc_, short(x - r), short(y - r),
-             uint(2*r), uint(2*r), 0, 360*64);
+  addArc(x, y, r, r, 0, 360*64, false);
 }
 
 void
 CXGraphics::
 fillCircle(int x, int y, int r)
 {
-  if (pixmap_)
-    XFillArc(display_, pixmap_->getPixmap(), gc_, short(x - r), short(y - r),
-             uint(2*r), uint(2*r), 0, 360*64);
-  else
-    XFillArc(display_, window_, gc_, short(x - r), short(y - r),
-             uint(2*r), uint(2*r), 0, 360*64);
+  if (useRender() && r > 0) {
+    flushDraw();
+
+    // enough segments to keep chord error below a quarter pixel
+    int n = std::max(8, int(std::ceil(M_PI/std::acos(std::max(-1.0, 1.0 - 0.25/r)))));
+
+    std::vector<XPointDouble> points(static_cast<size_t>(n));
+
+    for (int i = 0; i < n; ++i) {
+      double a = 2.0*M_PI*i/n;
+
+      points[uint(i)].x = x + r*std::cos(a);
+      points[uint(i)].y = y + r*std::sin(a);
+    }
+
+    if (fillRenderPolygon(points))
+      return;
+  }
+
+  addArc(x, y, r, r, 0, 360*64, true);
 }
 
 void
 CXGraphics::
 drawEllipse(int x, int y, int xr, int yr)
 {
-  if (pixmap_)
-    XDrawArc(display_, pixmap_->getPixmap(), gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), 0, 360*64);
-  else
-    XDrawArc(display_, window_, gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), 0, 360*64);
+  addArc(x, y, xr, yr, 0, 360*64, false);
 }
 
 void
 CXGraphics::
 fillEllipse(int x, int y, int xr, int yr)
 {
-  if (pixmap_)
-    XFillArc(display_, pixmap_->getPixmap(), gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), 0, 360*64);
-  else
-    XFillArc(display_, window_, gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), 0, 360*64);
+  addArc(x, y, xr, yr, 0, 360*64, true);
 }
 
 void
 CXGraphics::
 drawArc(int x, int y, int xr, int yr, double angle1, double angle2)
 {
-  if (pixmap_)
-    XDrawArc(display_, pixmap_->getPixmap(), gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), int(angle1*64), int(-angle2*64));
-  else
-    XDrawArc(display_, window_, gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), int(angle1*64), int(-angle2*64));
+  addArc(x, y, xr, yr, int(angle1*64), int(-angle2*64), false);
 }
 
 void
 CXGraphics::
 fillArc(int x, int y, int xr, int yr, double angle1, double angle2)
 {
-  if (pixmap_)
-    XFillArc(display_, pixmap_->getPixmap(), gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), int(angle1*64), int(-angle2*64));
+  addArc(x, y, xr, yr, int(angle1*64), int(-angle2*64), true);
+}
+
+void
+CXGraphics::
+addArc(int x, int y, int xr, int yr, int angle1, int angle2, bool fill)
+{
+  XArc arc;
+
+  arc.x      = clampCoord(x - xr);
+  arc.y      = clampCoord(y - yr);
+  arc.width  = ushort(std::max(std::min(2*xr, 0xFFFF), 0));
+  arc.height = ushort(std::max(std::min(2*yr, 0xFFFF), 0));
+  arc.angle1 = short(angle1);
+  arc.angle2 = short(angle2);
+
+  DrawBatch *batch = getDrawBatch();
+
+  if      (batch) {
+    if (fill)
+      batch->fill_arcs.push_back(arc);
+    else
+      batch->arcs.push_back(arc);
+  }
+  else if (fill)
+    XFillArc(display_, getDrawable(), gc_, arc.x, arc.y, arc.width, arc.height,
+             arc.angle1, arc.angle2);
   else
-    XFillArc(display_, window_, gc_, short(x - xr), short(y - yr),
-             uint(2*xr), uint(2*yr), int(angle1*64), int(-angle2*64));
+    XDrawArc(display_, getDrawable(), gc_, arc.x, arc.y, arc.width, arc.height,
+             arc.angle1, arc.angle2);
 }
 
 void
 CXGraphics::
 drawPoint(int x, int y)
 {
-  if (pixmap_)
-    CXMachineInst->drawPoint(pixmap_->getPixmap(), gc_, x, y);
+  DrawBatch *batch = getDrawBatch();
+
+  if (batch) {
+    XPoint point;
+
+    point.x = clampCoord(x);
+    point.y = clampCoord(y);
+
+    batch->points.push_back(point);
+  }
   else
-    CXMachineInst->drawPoint(window_, gc_, x, y);
+    CXMachineInst->drawPoint(getDrawable(), gc_, x, y);
 }
 
 void
 CXGraphics::
 drawImage(const CImagePtr &image, int x, int y)
 {
-  if (pixmap_)
-    CXMachineInst->drawImage(pixmap_->getPixmap(), gc_, image, x, y);
-  else
-    CXMachineInst->drawImage(window_, gc_, image, x, y);
+  flushDraw();
+
+  CXMachineInst->drawImage(getDrawable(), gc_, image, x, y);
 }
 
 void
@@ -469,101 +717,176 @@ CXGraphics::
 drawSubImage(const CImagePtr &image, int src_x, int src_y,
              int dst_x, int dst_y, int width, int height)
 {
-  if (pixmap_)
-    CXMachineInst->drawImage(pixmap_->getPixmap(), gc_, image,
-                             src_x, src_y, dst_x, dst_y, uint(width), uint(height));
-  else
-    CXMachineInst->drawImage(window_, gc_, image,
-                             src_x, src_y, dst_x, dst_y, uint(width), uint(height));
+  flushDraw();
+
+  CXMachineInst->drawImage(getDrawable(), gc_, image,
+                           src_x, src_y, dst_x, dst_y, uint(width), uint(height));
 }
 
 void
 CXGraphics::
 drawSubImage(XImage *ximage, int src_x, int src_y, int dst_x, int dst_y, int width, int height)
 {
-  if (pixmap_)
-    CXMachineInst->putImage(pixmap_->getPixmap(), gc_, ximage, src_x, src_y,
-                            dst_x, dst_y, uint(width), uint(height));
-  else
-    CXMachineInst->putImage(window_, gc_, ximage, src_x, src_y,
-                            dst_x, dst_y, uint(width), uint(height));
+  flushDraw();
+
+  CXMachineInst->putImage(getDrawable(), gc_, ximage, src_x, src_y,
+                          dst_x, dst_y, uint(width), uint(height));
 }
 
 void
 CXGraphics::
 drawAlphaImage(const CImagePtr &image, int x, int y)
 {
-  if (pixmap_) {
-    //CXMachineInst->drawImage(pixmap_->getPixmap(), gc_, image, x, y);
+  drawSubAlphaImage(image, 0, 0, x, y, int(image->getWidth()), int(image->getHeight()));
+}
 
-    uint width  = image->getWidth ();
-    uint height = image->getHeight();
+void
+CXGraphics::
+drawAlphaImage(XImage *ximage, int x, int y)
+{
+  drawSubAlphaImage(ximage, 0, 0, x, y, ximage->width, ximage->height);
+}
+
+// composite image over drawable contents client side : read back destination
+// area, blend src over dst and write result back in a single request
+void
+CXGraphics::
+drawSubAlphaImage(const CImagePtr &image, int src_x, int src_y,
+                  int dst_x, int dst_y, int width, int height)
+{
+  // opaque image needs no blending (or read back)
+  if (! image->isTransparent(COptReal(1.0)))
+    return drawSubImage(image, src_x, src_y, dst_x, dst_y, width, height);
 
-    for (uint iy = 0; iy < height; ++iy) {
-      for (uint ix = 0; ix < width; ++ix) {
-        if (! image->isTransparent(int(ix), int(iy))) {
-          CRGBA rgba;
+  flushDraw();
 
-          image->getRGBAPixel(int(ix), int(iy), rgba);
+  // let server blend when image can be uploaded as render picture
+  if (useRender() && width > 0 && height > 0) {
+    CXImage *cximage = image.cast<CXImage>();
 
-          setForeground(rgba);
+    Picture src = (cximage ? cximage->getXPicture() : None);
+    Picture dst = (src != None ? getRenderPicture() : None);
 
-          drawPoint(x + int(ix), y + int(iy));
-        }
-      }
+    if (dst != None) {
+      XRenderComposite(display_, PictOpOver, src, None, dst, src_x, src_y, 0, 0,
+                       dst_x, dst_y, uint(width), uint(height));
+      return;
     }
   }
-  else {
-    uint width  = image->getWidth ();
-    uint height = image->getHeight();
 
-    for (uint iy = 0; iy < height; ++iy) {
-      for (uint ix = 0; ix < width; ++ix) {
-        if (! image->isTransparent(int(ix), int(iy))) {
-          CRGBA rgba;
+  // clip to source image
+  if (src_x < 0) { dst_x -= src_x; width  += src_x; src_x = 0; }
+  if (src_y < 0) { dst_y -= src_y; height += src_y; src_y = 0; }
+
+  width  = std::min(width , int(image->getWidth ()) - src_x);
+  height = std::min(height, int(image->getHeight()) - src_y);
+
+  // clip to destination drawable
+  int dwidth, dheight;
+
+  if (pixmap_) {
+    dwidth  = int(pixmap_->getWidth ());
+    dheight = int(pixmap_->getHeight());
+  }
+  else
+    getSize(&dwidth, &dheight);
+
+  if (dst_x < 0) { src_x -= dst_x; width  += dst_x; dst_x = 0; }
+  if (dst_y < 0) { src_y -= dst_y; height += dst_y; dst_y = 0; }
+
+  width  = std::min(width , dwidth  - dst_x);
+  height = std::min(height, dheight - dst_y);
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  Drawable drawable = getDrawable();
+
+  // read back fails (skip draw) for unviewable window or area outside screen
+  XImage *ximage = CXMachineInst->getShmImage(drawable, dst_x, dst_y, uint(width), uint(height));
+
+  if (! ximage)
+    return;
+
+  // 8 bit per channel 32 bit pixels in host order can be blended in place
+  bool fast = (ximage->bits_per_pixel == 32 &&
+               ximage->byte_order == (CXUtil::isHostLSBFirst() ? LSBFirst : MSBFirst) &&
+               ximage->green_mask == 0x00FF00 &&
+               ((ximage->red_mask == 0xFF0000 && ximage->blue_mask == 0x0000FF) ||
+                (ximage->red_mask == 0x0000FF && ximage->blue_mask == 0xFF0000)));
+
+  bool swap = (fast && ximage->red_mask == 0x0000FF);
+
+  std::vector<uint> row(static_cast<size_t>(width));
 
-          image->getRGBAPixel(int(ix), int(iy), rgba);
+  for (int y = 0; y < height; ++y) {
+    getImageRow(image, src_x, src_y + y, width, &row[0]);
 
-          setForeground(rgba);
+    if (fast) {
+      if (swap)
+        CXUtil::swapRedBlue(&row[0], width);
 
-          drawPoint(x + int(ix), y + int(iy));
+      uint *drow = reinterpret_cast<uint *>(ximage->data + y*ximage->bytes_per_line);
+
+      CXUtil::blendARGB(drow, &row[0], width);
+    }
+    else {
+      for (int x = 0; x < width; ++x) {
+        uint s = row[uint(x)];
+        uint a = s >> 24;
+
+        if      (a == 0)
+          continue;
+        else if (a != 255) {
+          CRGBA rgba = screen_.pixelToRGBA(XGetPixel(ximage, x, y));
+
+          double a1 = a/255.0;
+          double a2 = 1.0 - a1;
+
+          rgba = CRGBA(((s >> 16) & 0xFF)/255.0*a1 + rgba.getRed  ()*a2,
+                       ((s >>  8) & 0xFF)/255.0*a1 + rgba.getGreen()*a2,
+                       ((s      ) & 0xFF)/255.0*a1 + rgba.getBlue ()*a2);
+
+          XPutPixel(ximage, x, y, screen_.rgbaToPixel(rgba));
         }
+        else
+          XPutPixel(ximage, x, y, screen_.rgbaToPixel(CRGBA(((s >> 16) & 0xFF)/255.0,
+                                                            ((s >>  8) & 0xFF)/255.0,
+                                                            ((s      ) & 0xFF)/255.0)));
       }
     }
   }
+
+  CXMachineInst->putImage(drawable, gc_, ximage, 0, 0, dst_x, dst_y, uint(width), uint(height));
+
+  CXMachineInst->destroyImage(ximage);
 }
 
+// get row of image pixels as 0xAARRGGBB
 void
 CXGraphics::
-drawSubAlphaImage(const CImagePtr &image, int src_x, int src_y,
-                  int dst_x, int dst_y, int width, int height)
+getImageRow(const CImagePtr &image, int x, int y, int n, uint *row) const
 {
-  if (! image->isTransparent(COptReal(0.5)))
-    return drawSubImage(image, src_x, src_y, dst_x, dst_y, width, height);
+  CXImage *cximage = image.cast<CXImage>();
 
-  CRGBA rgba;
-
-  src_x  = std::max(src_x , 0);
-  src_y  = std::max(src_y , 0);
-  width  = std::min(width , int(image->getWidth ()));
-  height = std::min(height, int(image->getHeight()));
-
-  int xx, yy;
+  if (cximage && ! cximage->hasColormap()) {
+    int ind = y*int(cximage->getWidth()) + x;
 
-  yy = dst_y;
+    for (int i = 0; i < n; ++i)
+      row[i] = cximage->getData(ind + i);
 
-  for (int y1 = src_y; y1 < height; ++y1, ++yy) {
-    xx = dst_x;
+    return;
+  }
 
-    for (int x1 = src_x; x1 < width; ++x1, ++xx) {
-      image->getRGBAPixel(x1, y1, rgba);
+  CRGBA rgba;
 
-      if (rgba.getAlpha() >= 0.5) {
-        setForeground(rgba);
+  for (int i = 0; i < n; ++i) {
+    image->getRGBAPixel(x + i, y, rgba);
 
-        drawPoint(xx, yy);
-      }
-    }
+    row[i] = (uint(rgba.getAlpha()*255 + 0.5) << 24) |
+             (uint(rgba.getRed  ()*255 + 0.5) << 16) |
+             (uint(rgba.getGreen()*255 + 0.5) <<  8) |
+             (uint(rgba.getBlue ()*255 + 0.5)      );
   }
 }
 
@@ -577,6 +900,108 @@ drawSubAlphaImage(XImage *image, int src_x, int src_y, int dst_x, int dst_y,
   drawSubAlphaImage(pimage, src_x, src_y, dst_x, dst_y, width, height);
 }
 
+// render extension used for blending and antialiased fills (not for xor drawing)
+bool
+CXGraphics::
+useRender() const
+{
+  return (! is_xor_ && CXMachineInst->hasRender());
+}
+
+// picture for current drawable (window or double buffer pixmap) with current clip
+Picture
+CXGraphics::
+getRenderPicture()
+{
+  Drawable drawable = getDrawable();
+
+  if (picture_ != None && picture_drawable_ != drawable)
+    resetRenderPicture();
+
+  if (picture_ == None) {
+    picture_ = CXMachineInst->createPicture(drawable);
+
+    if (picture_ == None)
+      return None;
+
+    picture_drawable_ = drawable;
+    picture_clip_     = false;
+  }
+
+  if (! picture_clip_) {
+    XRenderPictureAttributes attr;
+
+    if      (! clip_.active) {
+      attr.clip_mask = None;
+
+      XRenderChangePicture(display_, picture_, CPClipMask, &attr);
+    }
+    else if (clip_.mask != None) {
+      attr.clip_mask     = clip_.mask;
+      attr.clip_x_origin = clip_.dx;
+      attr.clip_y_origin = clip_.dy;
+
+      XRenderChangePicture(display_, picture_, CPClipMask | CPClipXOrigin | CPClipYOrigin, &attr);
+    }
+    else
+      XRenderSetPictureClipRectangles(display_, picture_, 0, 0, &clip_.rect, 1);
+
+    picture_clip_ = true;
+  }
+
+  return picture_;
+}
+
+// solid source picture for foreground color
+Picture
+CXGraphics::
+getRenderFill()
+{
+  if (fill_picture_ == None || fill_pixel_ != fg_.getPixel()) {
+    if (fill_picture_ != None)
+      CXMachineInst->freePicture(fill_picture_);
+
+    const CRGBA &rgba = fg_.getRGBA();
+
+    fill_picture_ = CXMachineInst->createSolidPicture(
+                      CRGBA(rgba.getRed(), rgba.getGreen(), rgba.getBlue()));
+    fill_pixel_   = fg_.getPixel();
+  }
+
+  return fill_picture_;
+}
+
+void
+CXGraphics::
+resetRenderPicture()
+{
+  if (picture_ != None)
+    CXMachineInst->freePicture(picture_);
+
+  picture_          = None;
+  picture_drawable_ = None;
+  picture_clip_     = false;
+}
+
+// antialiased polygon fill (split into trapezoids by XRenderCompositeDoublePoly)
+bool
+CXGraphics::
+fillRenderPolygon(const std::vector<XPointDouble> &points)
+{
+  Picture dst = getRenderPicture();
+  Picture src = (dst != None ? getRenderFill() : None);
+
+  if (src == None)
+    return false;
+
+  XRenderPictFormat *mask_format = XRenderFindStandardFormat(display_, PictStandardA8);
+
+  XRenderCompositeDoublePoly(display_, PictOpOver, src, dst, mask_format, 0, 0, 0, 0,
+                             &points[0], int(points.size()), 0);
+
+  return true;
+}
+
 bool
 CXGraphics::
 getImage(int x, int y, int width, int height, CImagePtr &image)
@@ -591,6 +1016,8 @@ getImage(int x, int y, int width, int height, CImagePtr &image)
 
   CXImage *cimage = new CXImage(ximage);
 
+  cimage->ximage_owner_ = true;
+
   image = CImagePtr(cimage);
 
   return true;
@@ -600,13 +1027,9 @@ bool
 CXGraphics::
 getImage(int x, int y, int width, int height, XImage **ximage)
 {
-  *ximage = nullptr;
+  flushDraw();
 
-  if (pixmap_)
-    *ximage = XGetImage(display_, pixmap_->getPixmap(), x, y, uint(width), uint(height),
-                        AllPlanes, ZPixmap);
-  else
-    *ximage = XGetImage(display_, window_, x, y, uint(width), uint(height), AllPlanes, ZPixmap);
+  *ximage = CXMachineInst->getImage(getDrawable(), x, y, uint(width), uint(height));
 
   return true;
 }
@@ -627,10 +1050,9 @@ drawText(int x, int y, const std::string &str)
 
   CXrtFont *xrt_font = xfont->getXrtFont();
 
-  if (pixmap_)
-    xrt_font->draw(pixmap_->getPixmap(), gc_, x, y, str);
-  else
-    xrt_font->draw(window_, gc_, x, y, str);
+  flushDraw();
+
+  xrt_font->draw(getDrawable(), gc_, x, y, str);
 }
 
 void
@@ -649,16 +1071,17 @@ drawTextImage(int x, int y, const std::string &str)
 
   CXrtFont *xrt_font = xfont->getXrtFont();
 
-  if (pixmap_)
-    xrt_font->drawImage(pixmap_->getPixmap(), gc_, x, y, str);
-  else
-    xrt_font->drawImage(window_, gc_, x, y, str);
+  flushDraw();
+
+  xrt_font->drawImage(getDrawable(), gc_, x, y, str);
 }
 
 void
 CXGraphics::
 startClip(int x, int y, int width, int height)
 {
+  flushDraw();
+
   XPoint points[4];
 
   points[0].x = short(x);
@@ -676,40 +1099,61 @@ startClip(int x, int y, int width, int height)
   XSetRegion(display_, gc_, region);
 
   XDestroyRegion(region);
+
+  clip_.active = true;
+  clip_.rect   = { short(x), short(y), ushort(std::max(width, 0)), ushort(std::max(height, 0)) };
+  clip_.mask   = None;
+
+  picture_clip_ = false;
 }
 
 void
 CXGraphics::
 startClip(Pixmap pixmap, int dx, int dy)
 {
+  flushDraw();
+
   XSetClipMask  (display_, gc_, pixmap);
   XSetClipOrigin(display_, gc_, dx, dy);
+
+  clip_.active = true;
+  clip_.mask   = pixmap;
+  clip_.dx     = dx;
+  clip_.dy     = dy;
+
+  picture_clip_ = false;
 }
 
 void
 CXGraphics::
 endClip()
 {
+  flushDraw();
+
   XSetClipMask  (display_, gc_, None);
   XSetClipOrigin(display_, gc_, 0, 0);
+
+  clip_ = Clip();
+
+  picture_clip_ = false;
 }
 
 void
 CXGraphics::
 copyArea(const CXGraphics &src, int src_x, int src_y, int dst_x, int dst_y, int width, int height)
 {
-  if (pixmap_)
-    CXMachineInst->copyArea(src.getXWindow(), pixmap_->getPixmap(), gc_,
-                            src_x, src_y, width, height, dst_x, dst_y);
-  else
-    CXMachineInst->copyArea(src.getXWindow(), window_, gc_,
-                            src_x, src_y, width, height, dst_x, dst_y);
+  flushDraw();
+
+  CXMachineInst->copyArea(src.getXWindow(), getDrawable(), gc_,
+                          src_x, src_y, width, height, dst_x, dst_y);
 }
 
 void
 CXGraphics::
 setLineType(CXLineType line_type)
 {
+  flushDraw();
+
   XGCValues gc_values;
 
   if (line_type == CX_LINE_TYPE_SOLID)
@@ -724,6 +1168,8 @@ void
 CXGraphics::
 setLineWidth(int line_width)
 {
+  flushDraw();
+
   XGCValues gc_values;
 
   gc_values.line_width = line_width;
@@ -776,30 +1222,118 @@ setFillComplex(bool comp)
   fill_complex_ = comp;
 }
 
+void
+CXGraphics::
+setBatchDraw(bool batch)
+{
+  if (! batch)
+    flushDraw();
+
+  batch_draw_ = batch;
+}
+
+void
+CXGraphics::
+setBatchSort(bool sort)
+{
+  if (! sort)
+    flushDraw();
+
+  batch_sort_ = sort;
+}
+
+// batch for current foreground (nullptr if not batching)
+CXGraphics::DrawBatch *
+CXGraphics::
+getDrawBatch()
+{
+  if (! batch_draw_ && ! in_double_buffer_)
+    return nullptr;
+
+  if (batch_size_ >= MAX_BATCH_SIZE)
+    flushDraw();
+
+  ++batch_size_;
+
+  return &batches_[fg_.getPixel()];
+}
+
+// send batched primitives, one request per primitive type and color
+void
+CXGraphics::
+flushDraw()
+{
+  if (batch_size_ == 0)
+    return;
+
+  Drawable drawable = getDrawable();
+
+  Pixel pixel = fg_.getPixel();
+
+  for (auto &pb : batches_) {
+    if (pb.first != pixel) {
+      pixel = pb.first;
+
+      XSetForeground(display_, gc_, pixel);
+    }
+
+    DrawBatch &batch = pb.second;
+
+    if (! batch.fill_rects.empty())
+      XFillRectangles(display_, drawable, gc_, &batch.fill_rects[0],
+                      int(batch.fill_rects.size()));
+
+    if (! batch.fill_arcs.empty())
+      XFillArcs(display_, drawable, gc_, &batch.fill_arcs[0], int(batch.fill_arcs.size()));
+
+    if (! batch.rects.empty())
+      XDrawRectangles(display_, drawable, gc_, &batch.rects[0], int(batch.rects.size()));
+
+    if (! batch.arcs.empty())
+      XDrawArcs(display_, drawable, gc_, &batch.arcs[0], int(batch.arcs.size()));
+
+    if (! batch.segments.empty())
+      XDrawSegments(display_, drawable, gc_, &batch.segments[0], int(batch.segments.size()));
+
+    if (! batch.points.empty())
+      XDrawPoints(display_, drawable, gc_, &batch.points[0], int(batch.points.size()),
+                  CoordModeOrigin);
+  }
+
+  if (pixel != fg_.getPixel())
+    XSetForeground(display_, gc_, fg_.getPixel());
+
+  batches_.clear();
+
+  batch_size_ = 0;
+}
+
+Drawable
+CXGraphics::
+getDrawable() const
+{
+  return (pixmap_ ? pixmap_->getPixmap() : window_);
+}
+
 bool
 CXGraphics::
 isPixmapWindow() const
 {
-  error_trapped = false;
-
-  XErrorHandler oldErrorHandler = XSetErrorHandler(newErrorHandler);
+  // window attributes of a pixmap fail (BadWindow)
+  CXMachineInst->trapStart();
 
   XWindowAttributes xwinattr;
 
   XGetWindowAttributes(display_, window_, &xwinattr);
 
-  CXMachineInst->flushEvents(false);
-
-  XSetErrorHandler(oldErrorHandler);
-
-  return error_trapped;
+  return ! CXMachineInst->trapEnd();
 }
 
 void
 CXGraphics::
 getSize(int *width, int *height) const
 {
-  XErrorHandler oldErrorHandler = XSetErrorHandler(newErrorHandler);
+  CXMachineInst->trapStart();
 
   *width  = 1;
   *height = 1;
@@ -807,10 +1341,10 @@ getSize(int *width, int *height) const
   if (! is_pixmap_) {
     XWindowAttributes xwinattr;
 
-    XGetWindowAttributes(display_, window_, &xwinattr);
-
-    *width  = xwinattr.width;
-    *height = xwinattr.height;
+    if (XGetWindowAttributes(display_, window_, &xwinattr)) {
+      *width  = xwinattr.width;
+      *height = xwinattr.height;
+    }
   }
   else {
     int    x;
@@ -821,15 +1355,14 @@ getSize(int *width, int *height) const
     uint   height1;
     uint   border_width;
 
-    XGetGeometry(display_, window_, &root, &x, &y, &width1, &height1, &border_width, &depth);
-
-    *width  = int(width1);
-    *height = int(height1);
+    if (XGetGeometry(display_, window_, &root, &x, &y, &width1, &height1,
+                     &border_width, &depth)) {
+      *width  = int(width1);
+      *height = int(height1);
+    }
   }
 
-  CXMachineInst->flushEvents(false);
-
-  XSetErrorHandler(oldErrorHandler);
+  CXMachineInst->trapEnd();
 }
 
 int
@@ -866,14 +1399,118 @@ void
 CXGraphics::
 flushEvents()
 {
+  flushDraw();
+
   screen_.flushEvents();
 }
 
-int
-CXGraphics::
-newErrorHandler(Display *, XErrorEvent *)
+//------
+
+static short
+clampCoord(int c)
+{
+  return short(std::max(std::min(c, MAX_COORD), MIN_COORD));
+}
+
+static bool
+isCoordInRange(int c)
+{
+  return (c >= MIN_COORD && c <= MAX_COORD);
+}
+
+// clip line to coordinate range (Liang-Barsky), returns false if outside
+static bool
+clipSegment(double &x1, double &y1, double &x2, double &y2)
+{
+  double dx = x2 - x1;
+  double dy = y2 - y1;
+
+  double p[4] = { -dx, dx, -dy, dy };
+  double q[4] = { x1 - MIN_COORD, MAX_COORD - x1, y1 - MIN_COORD, MAX_COORD - y1 };
+
+  double t1 = 0.0, t2 = 1.0;
+
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0.0) {
+      if (q[i] < 0.0)
+        return false;
+
+      continue;
+    }
+
+    double t = q[i]/p[i];
+
+    if (p[i] < 0.0) {
+      if (t > t2) return false;
+      if (t > t1) t1 = t;
+    }
+    else {
+      if (t < t1) return false;
+      if (t < t2) t2 = t;
+    }
+  }
+
+  double x = x1, y = y1;
+
+  if (t2 < 1.0) { x2 = x + t2*dx; y2 = y + t2*dy; }
+  if (t1 > 0.0) { x1 = x + t1*dx; y1 = y + t1*dy; }
+
+  return true;
+}
+
+// clip polygon to coordinate range (Sutherland-Hodgman)
+static void
+clipPolygon(std::vector<XPointDouble> &points)
 {
-  error_trapped = true;
+  // edges : 0 left, 1 right, 2 top, 3 bottom
+  auto inside = [](const XPointDouble &p, int edge) {
+    switch (edge) {
+      case 0 : return (p.x >= MIN_COORD);
+      case 1 : return (p.x <= MAX_COORD);
+      case 2 : return (p.y >= MIN_COORD);
+      default: return (p.y <= MAX_COORD);
+    }
+  };
+
+  auto intersect = [](const XPointDouble &p1, const XPointDouble &p2, int edge) {
+    XPointDouble p;
+
+    if (edge < 2) {
+      p.x = (edge == 0 ? MIN_COORD : MAX_COORD);
+      p.y = p1.y + (p2.y - p1.y)*(p.x - p1.x)/(p2.x - p1.x);
+    }
+    else {
+      p.y = (edge == 2 ? MIN_COORD : MAX_COORD);
+      p.x = p1.x + (p2.x - p1.x)*(p.y - p1.y)/(p2.y - p1.y);
+    }
 
-  return 0;
+    return p;
+  };
+
+  std::vector<XPointDouble> in;
+
+  for (int edge = 0; edge < 4; ++edge) {
+    in.swap(points);
+
+    points.clear();
+
+    size_t n = in.size();
+
+    for (size_t i = 0; i < n; ++i) {
+      const XPointDouble &p1 = in[(i + n - 1) % n];
+      const XPointDouble &p2 = in[i];
+
+      bool in1 = inside(p1, edge);
+      bool in2 = inside(p2, edge);
+
+      if      (in2) {
+        if (! in1)
+          points.push_back(intersect(p1, p2, edge));
+
+        points.push_back(p2);
+      }
+      else if (in1)
+        points.push_back(intersect(p1, p2, edge));
+    }
+  }
 }
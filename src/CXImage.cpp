@@ -1,8 +1,17 @@
 #include <CXImage.h>
 #include <CXMachine.h>
 #include <CXScreen.h>
+#include <CXUtil.h>
 #include <CImageMgr.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static void maskShiftBits(ulong full_mask, int *shift, int *bits);
+static int  ditherLevel(int v);
+static void packAlphaBits(const uint *row, int n, uchar *bits);
+
 void
 CXImage::
 setPrototype()
@@ -152,28 +161,38 @@ init()
   ximage_owner_ = false;
   pixmap_       = None;
   mask_         = None;
+  picture_      = None;
 }
 
 void
 CXImage::
 reset()
 {
-  delete [] xdata_;
-
   if (ximage_) {
     if (ximage_owner_) {
-      ximage_->data = nullptr;
-
-      XDestroyImage(ximage_);
+      if (CXMachineInst->isShmImage(ximage_))
+        CXMachineInst->destroyShmImage(ximage_);
+      else {
+        // our data (xdata_) is deleted below, other data (XGetImage) by Xlib
+        if (ximage_->data == reinterpret_cast<char *>(xdata_))
+          ximage_->data = nullptr;
+
+        XDestroyImage(ximage_);
+      }
     }
   }
 
+  delete [] xdata_;
+
   if (mask_ != None)
     XFreePixmap(screen_.getDisplay(), mask_);
 
   if (pixmap_ != None)
     XFreePixmap(screen_.getDisplay(), pixmap_);
 
+  if (picture_ != None)
+    CXMachineInst->freePicture(picture_);
+
   init();
 }
 
@@ -181,9 +200,7 @@ void
 CXImage::
 getXImage(Drawable drawable, int x, int y, int width, int height)
 {
-  Display *display = screen_.getDisplay();
-
-  ximage_ = XGetImage(display, drawable, x, y, uint(width), uint(height), AllPlanes, ZPixmap);
+  ximage_ = CXMachineInst->getImage(drawable, x, y, uint(width), uint(height));
 
   ximage_owner_ = true;
 }
@@ -202,14 +219,6 @@ createXImage()
 
   int xoffset = 0;
 
-  int size = getDataSize();
-
-  xdata_ = new uchar [size_t(size)];
-
-  int pad = BitmapPad(display);
-
-  int bytes_per_line = getRowSize();
-
   int x1, y1, x2, y2;
 
   getWindow(&x1, &y1, &x2, &y2);
@@ -217,9 +226,24 @@ createXImage()
   int width  = std::max(1, x2 - x1 + 1);
   int height = std::max(1, y2 - y1 + 1);
 
-  ximage_ = XCreateImage(display, visual, uint(screen_.getDepth()), format, xoffset,
-                         reinterpret_cast<char *>(xdata_), uint(width), uint(height),
-                         pad, bytes_per_line);
+  // use shared memory image if available (local display) and large enough
+  if (format == ZPixmap && width*height >= CXMachine::SHM_MIN_PIXELS)
+    ximage_ = CXMachineInst->createShmImage(visual, uint(screen_.getDepth()),
+                                            uint(width), uint(height));
+
+  if (! ximage_) {
+    int size = getDataSize();
+
+    xdata_ = new uchar [size_t(size)];
+
+    int pad = BitmapPad(display);
+
+    int bytes_per_line = getRowSize();
+
+    ximage_ = XCreateImage(display, visual, uint(screen_.getDepth()), format, xoffset,
+                           reinterpret_cast<char *>(xdata_), uint(width), uint(height),
+                           pad, bytes_per_line);
+  }
 
   if (! ximage_)
     std::cerr << "Failed to create ximage\n";
@@ -238,6 +262,10 @@ initXImage()
   if (! ximage_)
     return;
 
+  // dither to fixed palette rather than allocating a cell per color
+  if (screen_.getHasColormap() && initXImageDither())
+    return;
+
   CRGBA rgba;
 
   bool fast = (screen_.getDepth() == 32);
@@ -251,6 +279,9 @@ initXImage()
   int width = int(getWidth());
 
   if (! hasColormap()) {
+    if (initXImageRows())
+      return;
+
     int ind = y1*width;
 
     for (int y = y1; y <= y2; ++y) {
@@ -313,6 +344,312 @@ initXImage()
   }
 }
 
+// convert whole rows of rgba data straight into the ximage data for
+// TrueColor visuals (returns false if the ximage layout isn't supported)
+bool
+CXImage::
+initXImageRows()
+{
+  if (screen_.getHasColormap() || ximage_->format != ZPixmap)
+    return false;
+
+  if (ximage_->byte_order != (CXUtil::isHostLSBFirst() ? LSBFirst : MSBFirst))
+    return false;
+
+  int bpp = ximage_->bits_per_pixel;
+
+  if (bpp != 32 && bpp != 16)
+    return false;
+
+  int x1, y1, x2, y2;
+
+  getWindow(&x1, &y1, &x2, &y2);
+
+  if (! validPixel(x1, y1) || ! validPixel(x2, y2))
+    return false;
+
+  int red_shift, green_shift, blue_shift;
+  int red_bits , green_bits , blue_bits;
+
+  maskShiftBits(ximage_->red_mask  , &red_shift  , &red_bits  );
+  maskShiftBits(ximage_->green_mask, &green_shift, &green_bits);
+  maskShiftBits(ximage_->blue_mask , &blue_shift , &blue_bits );
+
+  if (red_bits == 0 || green_bits == 0 || blue_bits == 0 ||
+      red_bits > 8 || green_bits > 8 || blue_bits > 8)
+    return false;
+
+  int width = int(getWidth());
+  int nx    = x2 - x1 + 1;
+
+  char *data = ximage_->data;
+  int   bpl  = ximage_->bytes_per_line;
+
+  //---
+
+  // 8 bits per channel in 32 bits (data is already ARGB so only red/blue may need swapping)
+  if (bpp == 32 && red_bits == 8 && green_bits == 8 && blue_bits == 8 && green_shift == 8 &&
+      ((red_shift == 16 && blue_shift == 0) || (red_shift == 0 && blue_shift == 16))) {
+    bool swap = (red_shift == 0);
+
+    int ind = y1*width + x1;
+
+    for (int y = y1; y <= y2; ++y) {
+      uint *row = reinterpret_cast<uint *>(data + (y - y1)*bpl);
+
+      for (int x = 0; x < nx; ++x)
+        row[x] = getData(ind + x);
+
+      if (swap)
+        CXUtil::swapRedBlue(row, nx);
+
+      ind += width;
+    }
+
+    return true;
+  }
+
+  //---
+
+  // general packing of 8 bit channels into the visual's masks
+  uint alpha_mask = 0;
+
+  if (bpp == 32 && ((ximage_->red_mask | ximage_->green_mask | ximage_->blue_mask) &
+                    0xFF000000) == 0)
+    alpha_mask = 0xFF000000;
+
+  int ind = y1*width + x1;
+
+  for (int y = y1; y <= y2; ++y) {
+    uint   *row32 = reinterpret_cast<uint   *>(data + (y - y1)*bpl);
+    ushort *row16 = reinterpret_cast<ushort *>(data + (y - y1)*bpl);
+
+    for (int x = 0; x < nx; ++x) {
+      uint argb = getData(ind + x);
+
+      uint r = (argb >> 16) & 0xFF;
+      uint g = (argb >>  8) & 0xFF;
+      uint b = (argb      ) & 0xFF;
+
+      uint pixel1 = ((r >> (8 - red_bits  )) << red_shift  ) |
+                    ((g >> (8 - green_bits)) << green_shift) |
+                    ((b >> (8 - blue_bits )) << blue_shift ) |
+                    (argb & alpha_mask);
+
+      if (bpp == 32)
+        row32[x] = pixel1;
+      else
+        row16[x] = ushort(pixel1);
+    }
+
+    ind += width;
+  }
+
+  return true;
+}
+
+// dither rows to screen's color cube palette (false if not applicable)
+bool
+CXImage::
+initXImageDither()
+{
+  CXDitherType type = screen_.getDitherType();
+
+  if (type == CX_DITHER_NONE)
+    return false;
+
+  const CXDitherPalette *palette = screen_.getDitherPalette();
+
+  if (! palette)
+    return false;
+
+  // 8x8 Bayer matrix
+  static const int bayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+  };
+
+  const int n    = CXDitherPalette::LEVELS;
+  const int step = 255/(n - 1);
+
+  int x1, y1, x2, y2;
+
+  getWindow(&x1, &y1, &x2, &y2);
+
+  int width  = x2 - x1 + 1;
+  int height = y2 - y1 + 1;
+
+  if (width <= 0 || height <= 0)
+    return false;
+
+  bool byte_pixels = (ximage_->format == ZPixmap && ximage_->bits_per_pixel == 8);
+
+  std::vector<uint> row(static_cast<size_t>(width));
+
+  // error diffusion rows (3 channels, one pixel padding each side)
+  std::vector<int> err1, err2;
+
+  if (type == CX_DITHER_ERROR_DIFFUSION) {
+    err1.assign(3*size_t(width + 2), 0);
+    err2.assign(3*size_t(width + 2), 0);
+  }
+
+  for (int y = 0; y < height; ++y) {
+    getARGBRow(y1 + y, x1, width, &row[0]);
+
+    uchar *brow = (byte_pixels ? reinterpret_cast<uchar *>(ximage_->data) +
+                                 y*ximage_->bytes_per_line : nullptr);
+
+    for (int x = 0; x < width; ++x) {
+      uint argb = row[size_t(x)];
+
+      int c[3] = { int((argb >> 16) & 0xFF), int((argb >> 8) & 0xFF), int(argb & 0xFF) };
+
+      int ind = 0;
+
+      if (type == CX_DITHER_ORDERED) {
+        int t = ((2*bayer[y & 7][x & 7] + 1 - 64)*step)/128;
+
+        for (int i = 0; i < 3; ++i)
+          ind = ind*n + ditherLevel(c[i] + t);
+      }
+      else {
+        int *e = &err1[3*size_t(x + 1)];
+
+        for (int i = 0; i < 3; ++i) {
+          c[i] = std::min(std::max(c[i] + e[i]/16, 0), 255);
+
+          ind = ind*n + ditherLevel(c[i]);
+        }
+
+        // spread error of chosen cell's actual color (Floyd-Steinberg weights)
+        uint actual = palette->colors[ind];
+
+        int a[3] = { int((actual >> 16) & 0xFF), int((actual >> 8) & 0xFF), int(actual & 0xFF) };
+
+        for (int i = 0; i < 3; ++i) {
+          int d = c[i] - a[i];
+
+          err1[3*size_t(x + 2) + size_t(i)] += 7*d;
+          err2[3*size_t(x    ) + size_t(i)] += 3*d;
+          err2[3*size_t(x + 1) + size_t(i)] += 5*d;
+          err2[3*size_t(x + 2) + size_t(i)] +=   d;
+        }
+      }
+
+      Pixel pixel = palette->pixels[ind];
+
+      if (brow)
+        brow[x] = uchar(pixel);
+      else
+        XPutPixel(ximage_, x, y, pixel);
+    }
+
+    if (type == CX_DITHER_ERROR_DIFFUSION) {
+      std::swap(err1, err2);
+
+      std::fill(err2.begin(), err2.end(), 0);
+    }
+  }
+
+  return true;
+}
+
+// get n pixels of row y starting at x1 as 0xAARRGGBB (invalid pixels are black)
+void
+CXImage::
+getARGBRow(int y, int x1, int n, uint *row) const
+{
+  if (! hasColormap() && validPixel(x1, y) && validPixel(x1 + n - 1, y)) {
+    int ind = y*int(getWidth()) + x1;
+
+    for (int i = 0; i < n; ++i)
+      row[i] = getData(ind + i);
+
+    return;
+  }
+
+  CRGBA rgba;
+
+  for (int i = 0; i < n; ++i) {
+    if (! validPixel(x1 + i, y)) {
+      row[i] = 0xFF000000;
+      continue;
+    }
+
+    getRGBAPixel(x1 + i, y, rgba);
+
+    row[i] = (uint(rgba.getAlpha()*255 + 0.5) << 24) |
+             (uint(rgba.getRed  ()*255 + 0.5) << 16) |
+             (uint(rgba.getGreen()*255 + 0.5) <<  8) |
+             (uint(rgba.getBlue ()*255 + 0.5)      );
+  }
+}
+
+// nearest color cube level for 8 bit component value
+static int
+ditherLevel(int v)
+{
+  const int n = CXDitherPalette::LEVELS;
+
+  v = std::min(std::max(v, 0), 255);
+
+  return (v*(n - 1) + 127)/255;
+}
+
+static void
+maskShiftBits(ulong full_mask, int *shift, int *bits)
+{
+  *shift = 0;
+  *bits  = 0;
+
+  if (full_mask == 0)
+    return;
+
+  while (! (full_mask & 0x0001)) {
+    full_mask >>= 1;
+
+    ++(*shift);
+  }
+
+  while (full_mask & 0x0001) {
+    full_mask >>= 1;
+
+    ++(*bits);
+  }
+
+  // non-contiguous mask
+  if (full_mask != 0)
+    *bits = 0;
+}
+
+// set bit for each ARGB pixel with alpha >= 128 (top bit of alpha), LSBFirst
+static void
+packAlphaBits(const uint *row, int n, uchar *bits)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  for ( ; i + 8 <= n; i += 8) {
+    __m128 p1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i    )));
+    __m128 p2 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i + 4)));
+
+    bits[i >> 3] = uchar(_mm_movemask_ps(p1) | (_mm_movemask_ps(p2) << 4));
+  }
+#endif
+
+  for ( ; i < n; ++i) {
+    if (row[i] & 0x80000000)
+      bits[i >> 3] |= uchar(1 << (i & 7));
+  }
+}
+
 //----------------
 
 int
@@ -360,27 +697,34 @@ getXPixmap() const
 
     GC gc = CXMachineInst->createGC(pixmap_, 0, 0);
 
-    if (ximage_) {
-      Pixel pixel;
+    XImage *ximage = getXImage();
 
-      for (uint y = 0; y < height; ++y) {
-        for (uint x = 0; x < width; ++x) {
-          pixel = XGetPixel(ximage_, x, y);
+    if (ximage) {
+      // upload in bands of rows which fit in a single request
+      Display *display = screen_.getDisplay();
 
-          CXMachineInst->setForeground(gc, pixel);
+      long max_request = XExtendedMaxRequestSize(display);
 
-          CXMachineInst->drawPoint(pixmap_, gc, int(x), int(y));
-        }
+      if (max_request == 0)
+        max_request = XMaxRequestSize(display);
+
+      long max_bytes = 4*max_request - 64;
+
+      uint band_height = height;
+
+      if (ximage->bytes_per_line > 0)
+        band_height = uint(std::max(1L, max_bytes/ximage->bytes_per_line));
+
+      for (uint y = 0; y < height; y += band_height) {
+        uint h = std::min(band_height, height - y);
+
+        CXMachineInst->putImage(pixmap_, gc, ximage, 0, int(y), 0, int(y), width, h);
       }
     }
     else {
       CXMachineInst->setForeground(gc, 0);
 
-      for (uint y = 0; y < height; ++y) {
-        for (uint x = 0; x < width; ++x) {
-          CXMachineInst->drawPoint(pixmap_, gc, int(x), int(y));
-        }
-      }
+      CXMachineInst->fillRectangle(pixmap_, gc, 0, 0, int(width), int(height));
     }
 
     CXMachineInst->freeGC(gc);
@@ -398,55 +742,164 @@ getXMask() const
 
     getWindow(&x1, &y1, &x2, &y2);
 
-    int width = int(getWidth());
-
     uint pwidth  = uint(x2 - x1 + 1);
     uint pheight = uint(y2 - y1 + 1);
 
     //----
 
+    std::vector<uchar> bits;
+    uint               bytes_per_line;
+
+    getMaskBits(bits, &bytes_per_line);
+
     CXImage *th = const_cast<CXImage *>(this);
 
-    th->mask_ = CXMachineInst->createXPixmap(pwidth, pheight, 1);
+    th->mask_ = CXMachineInst->createXBitmap(&bits[0], pwidth, pheight);
+  }
+
+  return mask_;
+}
+
+// upload whole image as ARGB32 render picture (None if render not available)
+Picture
+CXImage::
+getXPicture() const
+{
+  if (picture_ == None) {
+    int width  = int(getWidth ());
+    int height = int(getHeight());
 
-    if (mask_ == None)
+    if (width <= 0 || height <= 0)
       return None;
 
-    //----
+    std::vector<uint> data(size_t(width)*size_t(height));
 
-    GC gc = CXMachineInst->createGC(mask_, 0, 0);
+    if (! hasColormap()) {
+      for (size_t i = 0; i < data.size(); ++i)
+        data[i] = getData(int(i));
+    }
+    else {
+      CRGBA rgba;
 
-    CXMachineInst->setForeground(gc, 0);
+      int ind = 0;
 
-    CXMachineInst->fillRectangle(mask_, gc, 0, 0, int(pwidth), int(pheight));
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x, ++ind) {
+          getRGBAPixel(x, y, rgba);
 
-    CXMachineInst->setForeground(gc, 1);
+          data[size_t(ind)] = (uint(rgba.getAlpha()*255 + 0.5) << 24) |
+                              (uint(rgba.getRed  ()*255 + 0.5) << 16) |
+                              (uint(rgba.getGreen()*255 + 0.5) <<  8) |
+                              (uint(rgba.getBlue ()*255 + 0.5)      );
+        }
+      }
+    }
 
-    double alpha;
+    CXUtil::premultiplyARGB(&data[0], int(data.size()));
 
-    int ind = y1*width;
+    CXImage *th = const_cast<CXImage *>(this);
 
-    for (int y = y1; y <= y2; ++y) {
-      int ind1 = ind + x1;
+    th->picture_ = CXMachineInst->createARGBPicture(&data[0], uint(width), uint(height));
+  }
 
-      for (int x = x1; x <= x2; ++x) {
-        if (validPixel(x, y)) {
-          alpha = getAlpha(ind1);
+  return picture_;
+}
 
-          if (alpha >= 0.5)
-            CXMachineInst->drawPoint(mask_, gc, x - x1, y - y1);
-        }
+// pack alpha >= 0.5 into 1 bit per pixel rows (LSBFirst, byte padded)
+void
+CXImage::
+getMaskBits(std::vector<uchar> &bits, uint *bytes_per_line) const
+{
+  int x1, y1, x2, y2;
 
-        ++ind1;
-      }
+  getWindow(&x1, &y1, &x2, &y2);
 
-      ind += width;
+  int width = int(getWidth());
+
+  int pwidth  = x2 - x1 + 1;
+  int pheight = y2 - y1 + 1;
+
+  *bytes_per_line = uint((pwidth + 7)/8);
+
+  bits.assign(std::max(size_t(*bytes_per_line)*size_t(pheight), size_t(1)), 0);
+
+  // argb data with alpha in top byte can be packed a row at a time
+  bool argb = (! hasColormap() && validPixel(x1, y1) && validPixel(x2, y2));
+
+  std::vector<uint> row;
+
+  if (argb)
+    row.resize(size_t(pwidth));
+
+  int ind = y1*width;
+
+  for (int y = y1; y <= y2; ++y) {
+    uchar *brow = &bits[size_t(y - y1)*(*bytes_per_line)];
+
+    int ind1 = ind + x1;
+
+    if (argb) {
+      for (int x = 0; x < pwidth; ++x)
+        row[size_t(x)] = getData(ind1 + x);
+
+      packAlphaBits(&row[0], pwidth, brow);
+    }
+    else {
+      for (int x = x1; x <= x2; ++x, ++ind1) {
+        if (validPixel(x, y) && getAlpha(ind1) >= 0.5)
+          brow[(x - x1) >> 3] |= uchar(1 << ((x - x1) & 7));
+      }
     }
 
-    CXMachineInst->freeGC(gc);
+    ind += width;
   }
+}
 
-  return mask_;
+// opaque runs of each row (e.g. for XShapeCombineRectangles)
+void
+CXImage::
+getMaskSpans(std::vector<XRectangle> &spans) const
+{
+  std::vector<uchar> bits;
+  uint               bytes_per_line;
+
+  getMaskBits(bits, &bytes_per_line);
+
+  int x1, y1, x2, y2;
+
+  getWindow(&x1, &y1, &x2, &y2);
+
+  int pwidth  = x2 - x1 + 1;
+  int pheight = y2 - y1 + 1;
+
+  spans.clear();
+
+  for (int y = 0; y < pheight; ++y) {
+    const uchar *brow = &bits[size_t(y)*bytes_per_line];
+
+    int x = 0;
+
+    while (x < pwidth) {
+      // skip clear bytes/bits
+      if (brow[x >> 3] == 0 && (x & 7) == 0) { x += 8; continue; }
+
+      if (! (brow[x >> 3] & (1 << (x & 7)))) { ++x; continue; }
+
+      int xs = x;
+
+      while (x < pwidth && (brow[x >> 3] & (1 << (x & 7))))
+        ++x;
+
+      XRectangle rect;
+
+      rect.x      = short(xs);
+      rect.y      = short(y);
+      rect.width  = ushort(x - xs);
+      rect.height = 1;
+
+      spans.push_back(rect);
+    }
+  }
 }
 
 void
@@ -601,6 +1054,8 @@ CXImage::
 setPixel(int pos, const CXColor &color)
 {
   if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     int x1, y1, x2, y2;
 
     getWindow(&x1, &y1, &x2, &y2);
@@ -617,8 +1072,11 @@ bool
 CXImage::
 setPixel(int x, int y, const CXColor &color)
 {
-  if (ximage_)
+  if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     XPutPixel(ximage_, x, y, color.getPixel());
+  }
 
   return CImage::setRGBAPixel(x, y, color.getRGBA());
 }
@@ -628,6 +1086,8 @@ CXImage::
 setColorIndexPixel(int pos, uint pixel)
 {
   if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     int x1, y1, x2, y2;
 
     getWindow(&x1, &y1, &x2, &y2);
@@ -644,8 +1104,11 @@ bool
 CXImage::
 setColorIndexPixel(int x, int y, uint pixel)
 {
-  if (ximage_)
+  if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     XPutPixel(ximage_, x, y, pixel);
+  }
 
   return CImage::setColorIndexPixel(x, y, pixel);
 }
@@ -656,11 +1119,9 @@ setRGBAData(uint *data)
 {
   CImage::setRGBAData(data);
 
-  if (ximage_) {
-    delete ximage_;
-
-    ximage_ = nullptr;
-  }
+  // cached image is stale (reset waits for pending shared memory puts)
+  if (ximage_)
+    reset();
 }
 
 void
@@ -676,11 +1137,9 @@ setRGBAData(const CRGBA &rgba, int left, int bottom, int right, int top)
 {
   CImage::setRGBAData(rgba, left, bottom, right, top);
 
-  if (ximage_) {
-    delete ximage_;
-
-    ximage_ = nullptr;
-  }
+  // cached image is stale (reset waits for pending shared memory puts)
+  if (ximage_)
+    reset();
 }
 
 bool
@@ -688,6 +1147,8 @@ CXImage::
 setRGBAPixel(int pos, const CRGBA &rgba)
 {
   if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     Pixel pixel = screen_.rgbaToPixel(rgba);
 
     int x1, y1, x2, y2;
@@ -707,6 +1168,8 @@ CXImage::
 setRGBAPixel(int x, int y, const CRGBA &rgba)
 {
   if (ximage_) {
+    CXMachineInst->syncShmImage(ximage_);
+
     Pixel pixel = screen_.rgbaToPixel(rgba);
 
     XPutPixel(ximage_, x, y, pixel);
@@ -3,12 +3,28 @@
 #include <CXFont.h>
 #include <CXPixmap.h>
 #include <CXAtom.h>
+#include <CXPropertyBatch.h>
+#include <CXSelection.h>
 #include <CXUtil.h>
 #include <CXtTimer.h>
+#include <CXTimer.h>
 #include <CWindow.h>
 
 #include <X11/XKBlib.h>
 #include <X11/extensions/shape.h>
+#include <X11/extensions/XShm.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 #include <COSSignal.h>
 #include <COSTimer.h>
@@ -18,7 +34,10 @@
 #include <CTimer.h>
 #include <CThrow.h>
 
-static bool selection_notify_received;
+static long long monotonicNSecs();
+static void      frameTimerProc(CXMachine *machine, int fd, short revents, void *data);
+static bool      checkSameWindowEvent(Display *display, const XEvent &event, XEvent *event1);
+static Bool      isSameWindowEvent(Display *display, XEvent *event, XPointer data);
 
 CXMachine *
 CXMachine::
@@ -46,6 +65,8 @@ CXMachine()
 
   atomMgr_ = std::make_unique<CXAtomMgr>(*this);
 
+  selection_ = std::make_unique<CXSelection>(*this);
+
   XSetErrorHandler(CXMachine::XErrorHandler);
 
   CWindowMgrInst->setFactory(new CXWindowFactory);
@@ -56,6 +77,12 @@ CXMachine()
 CXMachine::
 ~CXMachine()
 {
+  // selection requestor window needs open display
+  selection_.reset();
+
+  if (display_)
+    releaseShmSegment();
+
   for (int i = 0; i < num_screens_; ++i) {
     if (screens_.find(i) != screens_.end())
       delete screens_[i];
@@ -103,8 +130,19 @@ openDisplay(const std::string &display_name)
   if (CEnvInst.exists("CX_LIB_DEBUG"))
     enterDebugMode();
 
+  if (CEnvInst.exists("CX_LIB_NO_SHM"))
+    setUseShm(false);
+
+  if (CEnvInst.exists("CX_LIB_NO_RENDER"))
+    setUseRender(false);
+
+  if (CEnvInst.exists("CX_LIB_WINDOW_CACHE"))
+    setWindowCache(true);
+
   display_name_ = display_name;
 
+  atomMgr_->preloadAtoms();
+
   CXFont ::setPrototype();
   CXImage::setPrototype();
 
@@ -150,8 +188,19 @@ openXtDisplay(const std::string &display_name, const std::string &app_name, int
   if (CEnvInst.exists("CX_LIB_DEBUG"))
     enterDebugMode();
 
+  if (CEnvInst.exists("CX_LIB_NO_SHM"))
+    setUseShm(false);
+
+  if (CEnvInst.exists("CX_LIB_NO_RENDER"))
+    setUseRender(false);
+
+  if (CEnvInst.exists("CX_LIB_WINDOW_CACHE"))
+    setWindowCache(true);
+
   display_name_ = display_name;
 
+  atomMgr_->preloadAtoms();
+
   CXFont ::setPrototype();
   CXImage::setPrototype();
 
@@ -167,6 +216,10 @@ closeDisplay()
     return;
   }
 
+  selection_->resetDisplay();
+
+  resetExtensions();
+
   XCloseDisplay(display_);
 
   displays_[screen_num_] = nullptr;
@@ -184,6 +237,12 @@ CXMachine::
 setDisplay(Display *display)
 {
   if (display) {
+    if (display_ && display_ != display) {
+      selection_->resetDisplay();
+
+      resetExtensions();
+    }
+
     display_ = display;
 
     std::string display_name = DisplayString(display_);
@@ -195,8 +254,13 @@ setDisplay(Display *display)
     num_screens_ = ScreenCount(display_);
   }
   else {
-    if (display_)
+    if (display_) {
+      selection_->resetDisplay();
+
+      resetExtensions();
+
       displays_[screen_num_] = nullptr;
+    }
 
     display_      = nullptr;
     display_name_ = "";
@@ -400,6 +464,13 @@ Window
 CXMachine::
 getWindowParent(Window xwin) const
 {
+  CXMachine *th = const_cast<CXMachine *>(this);
+
+  CXWindowCache::Entry *entry = th->window_cache_.getEntry(xwin);
+
+  if (entry && entry->parent_valid)
+    return entry->parent;
+
   Window  root;
   Window  parent;
   Window *children;
@@ -412,7 +483,12 @@ getWindowParent(Window xwin) const
     XFree(children);
 
   if (parent == root)
-    return None;
+    parent = None;
+
+  if (entry) {
+    entry->parent       = parent;
+    entry->parent_valid = true;
+  }
 
   return parent;
 }
@@ -484,7 +560,9 @@ mainLoop(CXMachineEventProc proc)
         (*proc)(this, &event_);
     }
 
-    COSTimer::msleep(10);
+    selection_->checkTimeouts();
+
+    waitForEvents(selection_->getTimeout(-1));
   }
 }
 
@@ -501,44 +579,351 @@ mainLoop(uint twait, CXEventAdapter *adapter)
 
     CTimerMgrInst->tick();
 
+    // stays set only if an idle handler (adapter or window override) ran
+    idle_handler_ = true;
+
     if      (adapter)
       adapter->idleEvent();
     else if (event_adapter_)
       event_adapter_->idleEvent();
+    else
+      idle_handler_ = false;
 
-    COSTimer::msleep(twait);
+    // block until X input or user fd is ready, waking every twait msecs
+    // only when timers need to be ticked or idle handler called
+    bool poll = (idle_handler_ || CXTimer::hasTimers() || app_context_ != nullptr);
+
+    selection_->checkTimeouts();
+
+    waitForEvents(selection_->getTimeout(poll ? int(twait) : -1));
   }
 }
 
+// run tickEvent at nframes per second on absolute monotonic deadlines,
+// processing X events while waiting for the next frame
 void
 CXMachine::
 tickLoop(uint nframes, CXEventAdapter *adapter)
 {
-  long secs1, usecs1, secs2, usecs2, dsecs, dusecs;
+  const long long period = 1000000000LL/std::max(nframes, 1U);
+
+  frame_times_.clear();
+
+  frame_pos_    = 0;
+  frame_count_  = 0;
+  frame_missed_ = 0;
+
+  // frame timer fd wakes poll at deadline (else poll + clock_nanosleep)
+  int  timer_fd = -1;
+  bool due      = false;
+
+#ifdef __linux__
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+  if (timer_fd >= 0)
+    addFdHandler(timer_fd, POLLIN, frameTimerProc, &due);
+#endif
 
-  int usecs = 1000000/nframes;
+  long long deadline   = monotonicNSecs();
+  long long last_start = 0;
 
   while (true) {
-    COSTime::getHRTime(&secs1, &usecs1);
+    processPendingEvents();
 
-    while (eventPending()) {
-      nextEvent();
+    long long start = monotonicNSecs();
 
-      processEvent();
-    }
+    if (last_start)
+      addFrameTime(start - last_start);
+
+    last_start = start;
+
+    ++frame_count_;
 
     if      (adapter)
       adapter->tickEvent();
     else if (event_adapter_)
       event_adapter_->tickEvent();
 
-    COSTime::getHRTime(&secs2, &usecs2);
+    deadline += period;
+
+    long long now = monotonicNSecs();
+
+    if (now >= deadline) {
+      long long behind = (now - deadline)/period + 1;
+
+      if (frame_policy_ == CX_FRAME_CATCH_UP && behind <= MAX_CATCH_UP_FRAMES) {
+        // run late frame now, deadlines stay on the frame grid
+        ++frame_missed_;
+
+        continue;
+      }
+
+      // skip to next deadline after now
+      frame_missed_ += ulong(behind);
+
+      deadline += behind*period;
+    }
+
+    waitFrameDeadline(deadline, timer_fd, due);
+  }
+}
+
+void
+CXMachine::
+getFrameStats(CXFrameStats &stats) const
+{
+  stats = CXFrameStats();
+
+  stats.frames = frame_count_;
+  stats.missed = frame_missed_;
+
+  if (frame_times_.empty())
+    return;
+
+  double sum = 0.0;
+
+  for (const auto &t : frame_times_)
+    sum += t;
+
+  stats.mean = sum/double(frame_times_.size());
+
+  std::vector<double> times = frame_times_;
+
+  size_t i = std::min(times.size() - 1, (99*times.size())/100);
+
+  std::nth_element(times.begin(), times.begin() + long(i), times.end());
+
+  stats.p99 = times[i];
+}
+
+void
+CXMachine::
+processPendingEvents()
+{
+  while (eventPending()) {
+    nextEvent();
+
+    processEvent();
+  }
+
+  selection_->checkTimeouts();
+}
+
+// wait for absolute monotonic deadline while processing X events
+void
+CXMachine::
+waitFrameDeadline(long long deadline, int timer_fd, bool &due)
+{
+#ifdef __linux__
+  if (timer_fd >= 0) {
+    itimerspec its;
+
+    its.it_interval.tv_sec  = 0;
+    its.it_interval.tv_nsec = 0;
+    its.it_value.tv_sec     = time_t(deadline/1000000000LL);
+    its.it_value.tv_nsec    = long  (deadline%1000000000LL);
+
+    due = false;
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+      while (! due) {
+        if (waitForEvents(-1))
+          processPendingEvents();
+      }
+
+      return;
+    }
+  }
+#endif
+
+  while (true) {
+    long long now = monotonicNSecs();
+
+    if (now >= deadline)
+      break;
+
+    int msecs = int((deadline - now)/1000000);
+
+    if (msecs > 0) {
+      if (waitForEvents(msecs))
+        processPendingEvents();
+
+      continue;
+    }
+
+    // sleep remaining sub millisecond part
+    timespec ts;
+
+    ts.tv_sec  = time_t(deadline/1000000000LL);
+    ts.tv_nsec = long  (deadline%1000000000LL);
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+  }
+}
+
+void
+CXMachine::
+addFrameTime(long long nsecs)
+{
+  double msecs = double(nsecs)/1000000.0;
+
+  if (frame_times_.size() < MAX_FRAME_TIMES)
+    frame_times_.push_back(msecs);
+  else
+    frame_times_[frame_pos_] = msecs;
+
+  frame_pos_ = (frame_pos_ + 1) % MAX_FRAME_TIMES;
+}
+
+// merge queued events of same type and window into current event
+void
+CXMachine::
+compressEvent()
+{
+  XEvent event1;
+
+  switch (event_.type) {
+    case MotionNotify: {
+      if (! (event_compress_ & CX_COMPRESS_MOTION))
+        break;
+
+      // only merge motion at head of queue so order with buttons/keys is kept
+      while (XEventsQueued(display_, QueuedAfterReading) > 0) {
+        XPeekEvent(display_, &event1);
+
+        if (event1.type         != MotionNotify ||
+            event1.xmotion.window != event_.xmotion.window ||
+            event1.xmotion.state  != event_.xmotion.state)
+          break;
+
+        XNextEvent(display_, &event_);
+      }
+
+      event_last_time_ = getEventTime(&event_);
 
-    COSTime::diffHRTime(secs1, usecs1, secs2, usecs2, &dsecs, &dusecs);
+      break;
+    }
+    case Expose: {
+      if (! (event_compress_ & CX_COMPRESS_EXPOSE))
+        break;
+
+      while (checkSameWindowEvent(display_, event_, &event1))
+        addExposeRect(event1.xexpose);
+
+      // deliver accumulated damage now
+      event_.xexpose.count = 0;
+
+      break;
+    }
+    case ConfigureNotify: {
+      if (! (event_compress_ & CX_COMPRESS_CONFIGURE))
+        break;
+
+      while (checkSameWindowEvent(display_, event_, &event1))
+        event_ = event1;
+
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void
+CXMachine::
+addExposeRect(const XExposeEvent &event)
+{
+  if (expose_region_ && expose_win_ != event.window) {
+    XDestroyRegion(expose_region_);
+
+    expose_region_ = nullptr;
+  }
+
+  if (! expose_region_)
+    expose_region_ = XCreateRegion();
+
+  expose_win_ = event.window;
+
+  XRectangle rect;
+
+  rect.x      = short(event.x);
+  rect.y      = short(event.y);
+  rect.width  = ushort(event.width);
+  rect.height = ushort(event.height);
+
+  XUnionRectWithRegion(&rect, expose_region_, expose_region_);
+}
+
+void
+CXMachine::
+addFdHandler(int fd, short events, CXMachineFdProc proc, void *data)
+{
+  removeFdHandler(fd);
+
+  FdHandler handler;
+
+  handler.fd     = fd;
+  handler.events = events;
+  handler.proc   = proc;
+  handler.data   = data;
+
+  fd_handlers_.push_back(handler);
+}
+
+void
+CXMachine::
+removeFdHandler(int fd)
+{
+  for (auto p = fd_handlers_.begin(); p != fd_handlers_.end(); ++p) {
+    if ((*p).fd == fd) {
+      fd_handlers_.erase(p);
+      return;
+    }
+  }
+}
+
+// wait for X events or user fd activity (timeout -1 waits forever),
+// dispatches ready user fds and returns true if X events are available
+bool
+CXMachine::
+waitForEvents(int timeout_msecs)
+{
+  // send pending requests before blocking
+  XFlush(display_);
+
+  if (XEventsQueued(display_, QueuedAlready) > 0)
+    return true;
+
+  std::vector<pollfd> fds(fd_handlers_.size() + 1);
+
+  fds[0].fd      = ConnectionNumber(display_);
+  fds[0].events  = POLLIN;
+  fds[0].revents = 0;
+
+  for (size_t i = 0; i < fd_handlers_.size(); ++i) {
+    fds[i + 1].fd      = fd_handlers_[i].fd;
+    fds[i + 1].events  = fd_handlers_[i].events;
+    fds[i + 1].revents = 0;
+  }
+
+  int rc = poll(&fds[0], nfds_t(fds.size()), timeout_msecs);
 
-    if (dsecs == 0 && dusecs < usecs)
-      COSTimer::msleep(uint(usecs - dusecs));
+  if (rc <= 0) {
+    if (rc < 0 && errno != EINTR)
+      std::cerr << "poll failed: " << strerror(errno) << "\n";
+
+    return false;
+  }
+
+  // handlers may add/remove handlers so dispatch from copy
+  FdHandlers handlers = fd_handlers_;
+
+  for (size_t i = 0; i < handlers.size(); ++i) {
+    if (fds[i + 1].revents && handlers[i].proc)
+      (*handlers[i].proc)(this, handlers[i].fd, fds[i + 1].revents, handlers[i].data);
   }
+
+  return (fds[0].revents != 0);
 }
 
 bool
@@ -547,6 +932,9 @@ processEvent()
 {
   CEventAdapter *event_adapter = nullptr;
 
+  if (event_compress_ != CX_COMPRESS_NONE)
+    compressEvent();
+
   event_win_ = getEventWindow(&event_);
 
   CXWindow *window = lookupWindow(event_win_);
@@ -716,9 +1104,16 @@ processEvent()
       break;
     }
     case Expose: {
+      addExposeRect(event_.xexpose);
+
       if (event_.xexpose.count == 0) {
         if (event_adapter)
           event_adapter->exposeEvent();
+
+        XDestroyRegion(expose_region_);
+
+        expose_region_ = nullptr;
+        expose_win_    = None;
       }
 
       break;
@@ -763,7 +1158,7 @@ processEvent()
       break;
     }
     case SelectionClear: {
-      selectionClearEvent();
+      selectionClearEvent(&event_.xselectionclear);
 
       break;
     }
@@ -773,7 +1168,8 @@ processEvent()
       break;
     }
     case PropertyNotify: {
-//    const CXAtom &atom = getAtom(event_.xproperty.atom);
+      // INCR selection transfers
+      selection_->propertyNotifyEvent(&event_.xproperty);
 
       break;
     }
@@ -1006,6 +1402,8 @@ nextEvent(XEvent *event) const
     XtAppNextEvent(app_context_, event);
   else
     XNextEvent(display_, event);
+
+  cacheEvent(event);
 }
 
 bool
@@ -1105,21 +1503,36 @@ bool
 CXMachine::
 checkWindowEvent(Window xwin, uint event_mask, XEvent *event) const
 {
-  return XCheckWindowEvent(display_, xwin, event_mask, event);
+  if (! XCheckWindowEvent(display_, xwin, event_mask, event))
+    return false;
+
+  cacheEvent(event);
+
+  return true;
 }
 
 bool
 CXMachine::
 checkTypedEvent(int event_type, XEvent *event) const
 {
-  return XCheckTypedEvent(display_, event_type, event);
+  if (! XCheckTypedEvent(display_, event_type, event))
+    return false;
+
+  cacheEvent(event);
+
+  return true;
 }
 
 bool
 CXMachine::
 checkWindowTypedEvent(Window xwin, int event_type, XEvent *event) const
 {
-  return XCheckTypedWindowEvent(display_, xwin, event_type, event);
+  if (! XCheckTypedWindowEvent(display_, xwin, event_type, event))
+    return false;
+
+  cacheEvent(event);
+
+  return true;
 }
 
 void
@@ -1127,6 +1540,18 @@ CXMachine::
 maskEvent(uint mask, XEvent *event) const
 {
   XMaskEvent(display_, mask, event);
+
+  cacheEvent(event);
+}
+
+// keep window cache coherent with events removed from the queue
+void
+CXMachine::
+cacheEvent(const XEvent *event) const
+{
+  CXMachine *th = const_cast<CXMachine *>(this);
+
+  th->window_cache_.processEvent(*event);
 }
 
 void
@@ -1154,7 +1579,7 @@ getWindowEventMask(Window xwin) const
 {
   XWindowAttributes attr;
 
-  if (! XGetWindowAttributes(display_, xwin, &attr))
+  if (! queryWindowAttributes(xwin, attr, false))
     return 0;
 
   return uint(attr.your_event_mask);
@@ -1166,7 +1591,7 @@ getWindowViewable(Window xwin) const
 {
   XWindowAttributes attr;
 
-  if (! XGetWindowAttributes(display_, xwin, &attr))
+  if (! queryWindowAttributes(xwin, attr, true))
     return false;
 
   return (attr.map_state == IsViewable);
@@ -1219,7 +1644,7 @@ getWindowGeometry(Window xwin, int *x, int *y, int *width, int *height, int *bor
 {
   XWindowAttributes attr;
 
-  if (XGetWindowAttributes(display_, xwin, &attr)) {
+  if (queryWindowAttributes(xwin, attr, false)) {
     if (x)
       *x = attr.x;
 
@@ -1257,25 +1682,61 @@ getWindowGeometry(Window xwin, int *x, int *y, int *width, int *height, int *bor
   }
 }
 
-//----------------
+// window attributes (from window cache when enabled, map state is only
+// reused if no window has been mapped or unmapped since)
+bool
+CXMachine::
+queryWindowAttributes(Window xwin, XWindowAttributes &attr, bool map_state) const
+{
+  CXMachine *th = const_cast<CXMachine *>(this);
 
-CXWindow *
+  CXWindowCache::Entry *entry = th->window_cache_.getEntry(xwin);
+
+  if (window_cache_.isAttrValid(entry, map_state)) {
+    attr = entry->attr;
+    return true;
+  }
+
+  if (! XGetWindowAttributes(display_, xwin, &attr))
+    return false;
+
+  th->window_cache_.setAttributes(xwin, attr);
+
+  return true;
+}
+
+// cache entry for window if its WM properties can be cached
+CXWindowCache::Entry *
 CXMachine::
-lookupWindow(Window xwin) const
+getPropertyCacheEntry(Window xwin)
 {
-  for (int i = 0; i < num_screens_; ++i) {
-    CXScreenMap::const_iterator p = screens_.find(i);
+  if (! window_cache_.isEnabled())
+    return nullptr;
 
-    if (p == screens_.end())
-      continue;
+  CXWindowCache::Entry *entry = window_cache_.getEntry(xwin);
 
-    CXWindow *window = (*p).second->lookupWindow(xwin);
+  if (! entry) {
+    XWindowAttributes attr;
+
+    if (! queryWindowAttributes(xwin, attr, false))
+      return nullptr;
 
-    if (window)
-      return window;
+    entry = window_cache_.getEntry(xwin);
   }
 
-  return nullptr;
+  if (! entry || ! entry->properties)
+    return nullptr;
+
+  return entry;
+}
+
+//----------------
+
+CXWindow *
+CXMachine::
+lookupWindow(Window xwin) const
+{
+  return window_registry_.lookupWindow(xwin);
 }
 
 bool
@@ -1350,6 +1811,8 @@ CXMachine::
 destroyWindow(Window xwin)
 {
   XDestroyWindow(display_, xwin);
+
+  window_cache_.removeEntry(xwin);
 }
 
 void
@@ -1357,6 +1820,8 @@ CXMachine::
 mapWindow(Window xwin)
 {
   XMapWindow(display_, xwin);
+
+  window_cache_.invalidateMapState();
 }
 
 void
@@ -1364,6 +1829,8 @@ CXMachine::
 mapWindowRaised(Window xwin)
 {
   XMapRaised(display_, xwin);
+
+  window_cache_.invalidateMapState();
 }
 
 void
@@ -1371,6 +1838,8 @@ CXMachine::
 mapWindowChildren(Window xwin)
 {
   XMapSubwindows(display_, xwin);
+
+  window_cache_.invalidateMapState();
 }
 
 void
@@ -1378,6 +1847,8 @@ CXMachine::
 unmapWindow(Window xwin)
 {
   XUnmapWindow(display_, xwin);
+
+  window_cache_.invalidateMapState();
 }
 
 void
@@ -1385,6 +1856,9 @@ CXMachine::
 reparentWindow(Window xwin, Window parent_xwin, int x, int y)
 {
   XReparentWindow(display_, xwin, parent_xwin, x, y);
+
+  window_cache_.invalidateGeometry(xwin);
+  window_cache_.invalidateMapState();
 }
 
 void
@@ -1454,6 +1928,8 @@ CXMachine::
 moveWindow(Window xwin, int x, int y)
 {
   XMoveWindow(display_, xwin, x, y);
+
+  window_cache_.invalidateGeometry(xwin);
 }
 
 void
@@ -1464,6 +1940,8 @@ resizeWindow(Window xwin, int width, int height)
   height = std::max(height, 1);
 
   XResizeWindow(display_, xwin, uint(width), uint(height));
+
+  window_cache_.invalidateGeometry(xwin);
 }
 
 void
@@ -1471,6 +1949,8 @@ CXMachine::
 moveResizeWindow(Window xwin, int x, int y, int width, int height)
 {
   XMoveResizeWindow(display_, xwin, x, y, uint(width), uint(height));
+
+  window_cache_.invalidateGeometry(xwin);
 }
 
 void
@@ -1485,6 +1965,8 @@ CXMachine::
 configureWindow(Window xwin, uint mask, XWindowChanges *xwc)
 {
   XConfigureWindow(display_, xwin, mask, xwc);
+
+  window_cache_.invalidateGeometry(xwin);
 }
 
 void
@@ -1685,6 +2167,12 @@ void
 CXMachine::
 changeWindowAtributes(Window xwin, uint attr_mask, XSetWindowAttributes *attr)
 {
+  // cached entry depends on selected events, other attributes are refetched
+  if (attr_mask & CWEventMask)
+    window_cache_.removeEntry(xwin);
+  else
+    window_cache_.invalidateGeometry(xwin);
+
   XChangeWindowAttributes(display_, xwin, attr_mask, attr);
 }
 
@@ -1780,6 +2268,8 @@ setStringProperty(Window xwin, const CXAtom &name, const std::string &value)
                   8, PropModeReplace, reinterpret_cast<uchar *>(const_cast<char *>(value.c_str())),
                   int(value.size()));
 
+  window_cache_.invalidateProperty(xwin, name.getXAtom());
+
   return true;
 }
 
@@ -1857,6 +2347,8 @@ setStringListProperty(Window xwin, const CXAtom &name, char **strs, int num_strs
     XFree(text_prop.value);
   }
 
+  window_cache_.invalidateProperty(xwin, name.getXAtom());
+
   return true;
 }
 
@@ -2090,6 +2582,8 @@ CXMachine::
 deleteProperty(Window xwin, const CXAtom &name)
 {
   XDeleteProperty(display_, xwin, name.getXAtom());
+
+  window_cache_.invalidateProperty(xwin, name.getXAtom());
 }
 
 //------
@@ -2192,23 +2686,66 @@ getWMState(Window xwin)
   return state;
 }
 
+// WM state of many windows in a single round trip (-1 if not set)
+void
+CXMachine::
+getWMStates(const std::vector<Window> &xwins, std::vector<int> &states)
+{
+  states.clear();
+
+  states.resize(xwins.size(), -1);
+
+  if (! display_)
+    return;
+
+  CXPropertyBatch batch(display_);
+
+  Atom wm_state = getWMStateAtom().getXAtom();
+
+  for (const auto &xwin : xwins)
+    batch.add(xwin, wm_state, wm_state, 3);
+
+  batch.fetch();
+
+  for (uint i = 0; i < batch.getNumReplies(); ++i) {
+    int state;
+
+    if (batch.getReply(i).getInteger(&state))
+      states[i] = state;
+  }
+}
+
 bool
 CXMachine::
 getWMName(Window xwin, std::string &name)
 {
   name = "";
 
+  CXWindowCache::Entry *entry = getPropertyCacheEntry(xwin);
+
+  if (entry && entry->name_valid) {
+    name = entry->name;
+    return entry->has_name;
+  }
+
   XTextProperty text_prop;
 
-  if (! XGetWMName(display_, xwin, &text_prop))
-    return false;
+  bool rc = XGetWMName(display_, xwin, &text_prop);
 
-  const char *cname = reinterpret_cast<const char *>(text_prop.value);
+  if (rc) {
+    const char *cname = reinterpret_cast<const char *>(text_prop.value);
 
-  if (cname && cname[0] != '\0')
-    name = cname;
+    if (cname && cname[0] != '\0')
+      name = cname;
+  }
 
-  return true;
+  if (entry) {
+    entry->name       = name;
+    entry->has_name   = rc;
+    entry->name_valid = true;
+  }
+
+  return rc;
 }
 
 bool
@@ -2217,17 +2754,31 @@ getWMIconName(Window xwin, std::string &name)
 {
   name = "";
 
+  CXWindowCache::Entry *entry = getPropertyCacheEntry(xwin);
+
+  if (entry && entry->icon_valid) {
+    name = entry->icon_name;
+    return entry->has_icon;
+  }
+
   XTextProperty text_prop;
 
-  if (! XGetWMIconName(display_, xwin, &text_prop))
-    return false;
+  bool rc = XGetWMIconName(display_, xwin, &text_prop);
 
-  const char *cname = reinterpret_cast<const char *>(text_prop.value);
+  if (rc) {
+    const char *cname = reinterpret_cast<const char *>(text_prop.value);
 
-  if (cname && cname[0] != '\0')
-    name = cname;
+    if (cname && cname[0] != '\0')
+      name = cname;
+  }
 
-  return true;
+  if (entry) {
+    entry->icon_name  = name;
+    entry->has_icon   = rc;
+    entry->icon_valid = true;
+  }
+
+  return rc;
 }
 
 void
@@ -2299,15 +2850,41 @@ bool
 CXMachine::
 getWMClassHint(Window xwin, std::string &res_name, std::string &res_class)
 {
+  CXWindowCache::Entry *entry = getPropertyCacheEntry(xwin);
+
+  if (entry && entry->class_valid) {
+    if (! entry->has_class)
+      return false;
+
+    res_name  = entry->res_name;
+    res_class = entry->res_class;
+
+    return true;
+  }
+
   XClassHint class_hint;
 
-  if (! XGetClassHint(display_, xwin, &class_hint))
-    return false;
+  bool rc = XGetClassHint(display_, xwin, &class_hint);
 
-  res_name  = std::string(class_hint.res_name);
-  res_class = std::string(class_hint.res_name);
+  if (rc) {
+    res_name  = std::string(class_hint.res_name);
+    res_class = std::string(class_hint.res_class);
 
-  return true;
+    XFree(class_hint.res_name);
+    XFree(class_hint.res_class);
+  }
+
+  if (entry) {
+    entry->has_class   = rc;
+    entry->class_valid = true;
+
+    if (rc) {
+      entry->res_name  = res_name;
+      entry->res_class = res_class;
+    }
+  }
+
+  return rc;
 }
 
 bool
@@ -2347,6 +2924,8 @@ setWMClassHint(Window xwin, const std::string &res_name, const std::string &res_
     return false;
 #endif
 
+  window_cache_.invalidateProperty(xwin, XA_WM_CLASS);
+
   return true;
 }
 
@@ -3053,6 +3632,9 @@ bool
 CXMachine::
 selectInput(Window xwin, uint event_mask)
 {
+  // cached entry depends on selected events
+  window_cache_.removeEntry(xwin);
+
   return XSelectInput(display_, xwin, event_mask);
 }
 
@@ -3368,6 +3950,22 @@ createStipplePixmap()
   return stipple_bitmap;
 }
 
+// create depth 1 pixmap from packed LSBFirst bits (row padded to byte) in one upload
+Pixmap
+CXMachine::
+createXBitmap(const uchar *bits, uint width, uint height)
+{
+  return createXBitmap(getRoot(), bits, width, height);
+}
+
+Pixmap
+CXMachine::
+createXBitmap(Window xwin, const uchar *bits, uint width, uint height)
+{
+  return XCreateBitmapFromData(display_, xwin, reinterpret_cast<const char *>(bits),
+                               width, height);
+}
+
 void
 CXMachine::
 drawImage(Window xwin, GC gc, const CImagePtr &image, int x, int y)
@@ -3433,7 +4031,487 @@ CXMachine::
 putImage(Window xwin, GC gc, XImage *ximage, int src_x, int src_y,
          int dst_x, int dst_y, uint width, uint height)
 {
-  XPutImage(display_, xwin, gc, ximage, src_x, src_y, dst_x, dst_y, width, height);
+  if (isShmImage(ximage)) {
+    // server reads segment when it processes request (see syncShmImage)
+    shm_put_serial_ = NextRequest(display_);
+
+    XShmPutImage(display_, xwin, gc, ximage, src_x, src_y, dst_x, dst_y, width, height, False);
+  }
+  else
+    XPutImage(display_, xwin, gc, ximage, src_x, src_y, dst_x, dst_y, width, height);
+}
+
+XImage *
+CXMachine::
+getImage(Window xwin, int x, int y, uint width, uint height)
+{
+  XImage *ximage = getShmImage(xwin, x, y, width, height);
+
+  if (! ximage || ! isShmImage(ximage))
+    return ximage;
+
+  // copy shared memory image so caller can free it with XDestroyImage
+  size_t size = size_t(ximage->bytes_per_line)*size_t(ximage->height);
+
+  char *data = static_cast<char *>(malloc(size));
+
+  XImage *ximage1 = nullptr;
+
+  if (data) {
+    memcpy(data, ximage->data, size);
+
+    ximage1 = XCreateImage(display_, nullptr, uint(ximage->depth), ximage->format, 0, data,
+                           uint(ximage->width), uint(ximage->height),
+                           ximage->bitmap_pad, ximage->bytes_per_line);
+
+    if (ximage1) {
+      ximage1->red_mask   = ximage->red_mask;
+      ximage1->green_mask = ximage->green_mask;
+      ximage1->blue_mask  = ximage->blue_mask;
+    }
+    else
+      free(data);
+  }
+
+  destroyShmImage(ximage);
+
+  return ximage1;
+}
+
+XImage *
+CXMachine::
+getShmImage(Window xwin, int x, int y, uint width, uint height)
+{
+  Visual *visual;
+  uint    depth;
+
+  if (hasShmImage() && ulong(width)*ulong(height) >= SHM_MIN_PIXELS &&
+      getDrawableFormat(xwin, &visual, &depth)) {
+    XImage *ximage = createShmGetImage(visual, depth, width, height);
+
+    if (ximage) {
+      trapStart();
+
+      Status status = XShmGetImage(display_, xwin, ximage, x, y, AllPlanes);
+
+      if (trapEnd() && status)
+        return ximage;
+
+      destroyShmImage(ximage);
+    }
+  }
+
+  // unviewable window or area outside screen gives BadMatch (nullptr returned)
+  trapStart();
+
+  XImage *ximage = XGetImage(display_, xwin, x, y, width, height, AllPlanes, ZPixmap);
+
+  if (! trapEnd()) {
+    if (ximage)
+      XDestroyImage(ximage);
+
+    return nullptr;
+  }
+
+  return ximage;
+}
+
+// check shared memory images can be used (extension present and local connection)
+bool
+CXMachine::
+hasShmImage() const
+{
+  if (! shm_checked_) {
+    CXMachine *th = const_cast<CXMachine *>(this);
+
+    th->shm_checked_   = true;
+    th->shm_available_ = false;
+
+    int  major, minor;
+    Bool pixmaps;
+
+    if (use_shm_ && display_ && XShmQueryVersion(display_, &major, &minor, &pixmaps))
+      th->shm_available_ = true;
+  }
+
+  return shm_available_;
+}
+
+// create ZPixmap image with data in a shared memory segment (nullptr if not available)
+XImage *
+CXMachine::
+createShmImage(Visual *visual, uint depth, uint width, uint height)
+{
+  if (! hasShmImage())
+    return nullptr;
+
+  // freed by XDestroyImage (obdata)
+  XShmSegmentInfo *shminfo = static_cast<XShmSegmentInfo *>(calloc(1, sizeof(XShmSegmentInfo)));
+
+  XImage *ximage = XShmCreateImage(display_, visual, depth, ZPixmap, nullptr,
+                                   shminfo, width, height);
+
+  if (! ximage) {
+    free(shminfo);
+    return nullptr;
+  }
+
+  size_t size = size_t(ximage->bytes_per_line)*size_t(ximage->height);
+
+  shminfo->shmid = shmget(IPC_PRIVATE, std::max(size, size_t(1)), IPC_CREAT | 0600);
+
+  if (shminfo->shmid < 0) {
+    XDestroyImage(ximage);
+    return nullptr;
+  }
+
+  shminfo->shmaddr = static_cast<char *>(shmat(shminfo->shmid, nullptr, 0));
+
+  if (shminfo->shmaddr == reinterpret_cast<char *>(-1)) {
+    shmctl(shminfo->shmid, IPC_RMID, nullptr);
+
+    XDestroyImage(ximage);
+
+    return nullptr;
+  }
+
+  ximage->data = shminfo->shmaddr;
+
+  shminfo->readOnly = False;
+
+  // attach fails for remote connections so disable shared memory on error
+  trapStart();
+
+  Status status = XShmAttach(display_, shminfo);
+
+  bool rc = (trapEnd() && status);
+
+  // segment is removed when last process detaches
+  shmctl(shminfo->shmid, IPC_RMID, nullptr);
+
+  if (! rc) {
+    shmdt(shminfo->shmaddr);
+
+    ximage->data = nullptr;
+
+    XDestroyImage(ximage);
+
+    shm_available_ = false;
+
+    return nullptr;
+  }
+
+  return ximage;
+}
+
+bool
+CXMachine::
+isShmImage(XImage *ximage) const
+{
+  return (ximage && ximage->obdata != nullptr);
+}
+
+// wait for server to finish reading shared memory image data sent by
+// putImage before the data is changed or freed
+void
+CXMachine::
+syncShmImage(XImage *ximage)
+{
+  if (! display_ || ! isShmImage(ximage) || shm_put_serial_ == 0)
+    return;
+
+  if (LastKnownRequestProcessed(display_) < shm_put_serial_)
+    XSync(display_, False);
+
+  shm_put_serial_ = 0;
+}
+
+void
+CXMachine::
+destroyShmImage(XImage *ximage)
+{
+  // keep reusable getShmImage segment attached (only image header is freed)
+  if (ximage->obdata == shm_get_info_) {
+    syncShmImage(ximage);
+
+    ximage->data   = nullptr;
+    ximage->obdata = nullptr;
+
+    XDestroyImage(ximage);
+
+    shm_get_busy_ = false;
+
+    return;
+  }
+
+  XShmSegmentInfo *shminfo = reinterpret_cast<XShmSegmentInfo *>(ximage->obdata);
+
+  XShmDetach(display_, shminfo);
+
+  // ensure server is finished with segment
+  XSync(display_, False);
+
+  shmdt(shminfo->shmaddr);
+
+  ximage->data = nullptr;
+
+  XDestroyImage(ximage);
+}
+
+// visual and depth of window or pixmap. Drawables of the screen's default
+// depth use its default visual, others are queried as windows (pixmaps of
+// other depths get no visual)
+bool
+CXMachine::
+getDrawableFormat(Drawable drawable, Visual **visual, uint *depth) const
+{
+  Window root;
+  int    x, y;
+  uint   width, height, border;
+
+  trapStart();
+
+  Status status = XGetGeometry(display_, drawable, &root, &x, &y, &width, &height, &border, depth);
+
+  if (! trapEnd() || ! status)
+    return false;
+
+  *visual = nullptr;
+
+  for (int i = 0; i < ScreenCount(display_); ++i) {
+    if (RootWindow(display_, i) != root)
+      continue;
+
+    if (DefaultDepth(display_, i) == int(*depth)) {
+      *visual = DefaultVisual(display_, i);
+
+      return true;
+    }
+
+    break;
+  }
+
+  XWindowAttributes attr;
+
+  trapStart();
+
+  bool is_window = queryWindowAttributes(drawable, attr, false);
+
+  if (trapEnd() && is_window)
+    *visual = attr.visual;
+
+  return true;
+}
+
+// shared memory image for getShmImage in a segment which is kept and reused
+// (grown as needed) while no other image is using it
+XImage *
+CXMachine::
+createShmGetImage(Visual *visual, uint depth, uint width, uint height)
+{
+  if (shm_get_busy_)
+    return createShmImage(visual, depth, width, height);
+
+  XShmSegmentInfo *shminfo = static_cast<XShmSegmentInfo *>(shm_get_info_);
+
+  if (shminfo) {
+    XImage *ximage = XShmCreateImage(display_, visual, depth, ZPixmap, shminfo->shmaddr,
+                                     shminfo, width, height);
+
+    if (ximage && size_t(ximage->bytes_per_line)*size_t(ximage->height) <= shm_get_size_) {
+      shm_get_busy_ = true;
+
+      return ximage;
+    }
+
+    if (ximage) {
+      ximage->data   = nullptr;
+      ximage->obdata = nullptr;
+
+      XDestroyImage(ximage);
+    }
+
+    releaseShmSegment();
+  }
+
+  XImage *ximage = createShmImage(visual, depth, width, height);
+
+  if (! ximage)
+    return nullptr;
+
+  shm_get_info_ = ximage->obdata;
+  shm_get_size_ = size_t(ximage->bytes_per_line)*size_t(ximage->height);
+  shm_get_busy_ = true;
+
+  return ximage;
+}
+
+void
+CXMachine::
+releaseShmSegment()
+{
+  XShmSegmentInfo *shminfo = static_cast<XShmSegmentInfo *>(shm_get_info_);
+
+  if (! shminfo)
+    return;
+
+  XShmDetach(display_, shminfo);
+
+  XSync(display_, False);
+
+  shmdt(shminfo->shmaddr);
+
+  free(shminfo);
+
+  shm_get_info_ = nullptr;
+  shm_get_size_ = 0;
+  shm_get_busy_ = false;
+}
+
+void
+CXMachine::
+resetExtensions()
+{
+  releaseShmSegment();
+
+  shm_checked_    = false;
+  shm_put_serial_ = 0;
+
+  render_checked_ = false;
+}
+
+// destroy image returned by getShmImage
+void
+CXMachine::
+destroyImage(XImage *ximage)
+{
+  if (isShmImage(ximage))
+    destroyShmImage(ximage);
+  else
+    XDestroyImage(ximage);
+}
+
+// check render extension can be used (0.10 or later for solid fill pictures)
+bool
+CXMachine::
+hasRender() const
+{
+  if (! render_checked_) {
+    CXMachine *th = const_cast<CXMachine *>(this);
+
+    th->render_checked_   = true;
+    th->render_available_ = false;
+
+    int event_base, error_base, major, minor;
+
+    if (use_render_ && display_ &&
+        XRenderQueryExtension(display_, &event_base, &error_base) &&
+        XRenderQueryVersion(display_, &major, &minor) &&
+        (major > 0 || minor >= 10))
+      th->render_available_ = true;
+  }
+
+  return render_available_;
+}
+
+// create render picture for window or pixmap (None if no matching format)
+Picture
+CXMachine::
+createPicture(Drawable drawable)
+{
+  if (! hasRender())
+    return None;
+
+  Window root;
+  int    x, y;
+  uint   width, height, border_width, depth;
+
+  if (! XGetGeometry(display_, drawable, &root, &x, &y, &width, &height, &border_width, &depth))
+    return None;
+
+  XRenderPictFormat *format = nullptr;
+
+  if      (int(depth) == getDepth(0))
+    format = XRenderFindVisualFormat(display_, getVisual(0));
+  else if (depth == 32)
+    format = XRenderFindStandardFormat(display_, PictStandardARGB32);
+  else if (depth == 8)
+    format = XRenderFindStandardFormat(display_, PictStandardA8);
+  else if (depth == 1)
+    format = XRenderFindStandardFormat(display_, PictStandardA1);
+
+  if (! format)
+    return None;
+
+  return XRenderCreatePicture(display_, drawable, format, 0, nullptr);
+}
+
+// upload premultiplied 0xAARRGGBB data to an ARGB32 picture
+Picture
+CXMachine::
+createARGBPicture(const uint *data, uint width, uint height)
+{
+  if (! hasRender() || width == 0 || height == 0)
+    return None;
+
+  XRenderPictFormat *format = XRenderFindStandardFormat(display_, PictStandardARGB32);
+
+  if (! format)
+    return None;
+
+  Pixmap xpixmap = createXPixmap(width, height, 32);
+
+  XImage *ximage = XCreateImage(display_, getVisual(0), 32, ZPixmap, 0,
+                                reinterpret_cast<char *>(const_cast<uint *>(data)),
+                                width, height, 32, int(4*width));
+
+  // data is in host byte order (Xlib swaps if server differs)
+  uint i = 1;
+
+  ximage->byte_order = (*reinterpret_cast<uchar *>(&i) == 1 ? LSBFirst : MSBFirst);
+
+  GC gc = XCreateGC(display_, xpixmap, 0, nullptr);
+
+  XPutImage(display_, xpixmap, gc, ximage, 0, 0, 0, 0, width, height);
+
+  XFreeGC(display_, gc);
+
+  ximage->data = nullptr;
+
+  XDestroyImage(ximage);
+
+  Picture picture = XRenderCreatePicture(display_, xpixmap, format, 0, nullptr);
+
+  // picture keeps reference to pixmap
+  XFreePixmap(display_, xpixmap);
+
+  return picture;
+}
+
+Picture
+CXMachine::
+createSolidPicture(const CRGBA &rgba)
+{
+  if (! hasRender())
+    return None;
+
+  double a = rgba.getAlpha();
+
+  XRenderColor color;
+
+  color.red   = ushort(rgba.getRed  ()*a*0xFFFF + 0.5);
+  color.green = ushort(rgba.getGreen()*a*0xFFFF + 0.5);
+  color.blue  = ushort(rgba.getBlue ()*a*0xFFFF + 0.5);
+  color.alpha = ushort(               a*0xFFFF + 0.5);
+
+  return XRenderCreateSolidFill(display_, &color);
+}
+
+void
+CXMachine::
+freePicture(Picture picture)
+{
+  XRenderFreePicture(display_, picture);
 }
 
 XFontStruct *
@@ -3854,37 +4932,125 @@ void
 CXMachine::
 trapStart() const
 {
-  flushEvents();
-
   CXMachine *th = const_cast<CXMachine *>(this);
 
-  th->trap_request_code_ = 0;
-  th->trap_error_code_   = 0;
+  th->pruneTraps();
+
+  ErrorTrap trap;
+
+  if (display_)
+    trap.start_serial = NextRequest(display_);
 
-  th->trap_active_ = true;
+  th->traps_.push_back(trap);
 }
 
 bool
 CXMachine::
 trapEnd() const
 {
-  flushEvents();
+  CXMachine *th = const_cast<CXMachine *>(this);
+
+  if (traps_.empty())
+    return true;
 
+  ErrorTrap &trap = th->traps_.back();
+
+  if (display_) {
+    trap.end_serial = NextRequest(display_);
+
+    // errors arrive in request order so once a later reply has been read
+    // all errors of the trapped requests have been handled
+    if (trap.end_serial > trap.start_serial &&
+        LastKnownRequestProcessed(display_) < trap.end_serial - 1)
+      XSync(display_, False);
+  }
+
+  th->trap_request_code_ = trap.request_code;
+  th->trap_error_code_   = trap.error_code;
+
+  th->traps_.pop_back();
+
+  return (trap_request_code_ == 0 && trap_error_code_ == 0);
+}
+
+void
+CXMachine::
+trapEndAsync() const
+{
   CXMachine *th = const_cast<CXMachine *>(this);
 
-  th->trap_active_ = false;
+  if (traps_.empty())
+    return;
+
+  ErrorTrap trap = traps_.back();
+
+  th->traps_.pop_back();
+
+  if (! display_)
+    return;
+
+  trap.end_serial = NextRequest(display_);
+
+  // keep serial range until its requests have been processed
+  if (trap.end_serial > trap.start_serial)
+    th->ended_traps_.push_back(trap);
+
+  th->pruneTraps();
+}
 
-  if (trap_request_code_ != 0 || trap_error_code_ != 0)
+// record error if its request is trapped (innermost trap wins)
+bool
+CXMachine::
+trapError(const XErrorEvent *event)
+{
+  if (! event || event->display != display_)
     return false;
-  else
+
+  ulong serial = event->serial;
+
+  for (auto &trap : ended_traps_) {
+    if (serial >= trap.start_serial && serial < trap.end_serial)
+      return true;
+  }
+
+  for (auto p = traps_.rbegin(); p != traps_.rend(); ++p) {
+    ErrorTrap &trap = *p;
+
+    if (serial < trap.start_serial)
+      continue;
+
+    if (trap.error_code == 0) {
+      trap.request_code = event->request_code;
+      trap.error_code   = event->error_code;
+    }
+
     return true;
+  }
+
+  return false;
+}
+
+// remove ended traps whose requests have all been processed
+void
+CXMachine::
+pruneTraps()
+{
+  if (ended_traps_.empty() || ! display_)
+    return;
+
+  ulong last = LastKnownRequestProcessed(display_);
+
+  auto p = std::remove_if(ended_traps_.begin(), ended_traps_.end(),
+                          [&](const ErrorTrap &trap) { return last >= trap.end_serial - 1; });
+
+  ended_traps_.erase(p, ended_traps_.end());
 }
 
 int
 CXMachine::
 XErrorHandler(Display *, XErrorEvent *event)
 {
-  if (CXMachineInst->trap_active_)
+  if (CXMachineInst->trapError(event))
     return False;
 
   const char *routine = "????";
@@ -4071,127 +5237,81 @@ bool
 CXMachine::
 selectionSetText(Window xwin, const std::string &text)
 {
-  XSetSelectionOwner(display_, XA_PRIMARY, xwin, CurrentTime);
-
-  if (XGetSelectionOwner(display_, XA_PRIMARY) != xwin)
-    return false;
-
-  selection_xwin_ = xwin;
-  selection_text_ = text;
-  selection_set_  = true;
-
-  return true;
+  return selection_->setText(XA_PRIMARY, xwin, text);
 }
 
 void
 CXMachine::
 selectionResetText(Window)
 {
-  XSetSelectionOwner(display_, XA_PRIMARY, None, CurrentTime);
+  selection_->reset(XA_PRIMARY);
 }
 
 void
 CXMachine::
-selectionClearEvent()
+selectionClearEvent(XSelectionClearEvent *event)
 {
+  Window xwin = selection_->getOwner(event->selection);
+
+  if (! selection_->selectionClearEvent(event))
+    return;
+
   CXEventAdapter *event_adapter = nullptr;
 
-  if (selection_xwin_ != None) {
-    CXWindow *window = lookupWindow(selection_xwin_);
+  CXWindow *window = lookupWindow(xwin);
 
-    if (window)
-      event_adapter = window->getXEventAdapter();
-  }
+  if (window)
+    event_adapter = window->getXEventAdapter();
 
   if (! event_adapter)
     event_adapter = event_adapter_.get();
 
   if (event_adapter)
     event_adapter->selectionClearEvent();
-
-  selection_xwin_ = None;
-  selection_text_ = "";
-  selection_set_  = false;
 }
 
 void
 CXMachine::
 selectionRequestEvent(XSelectionRequestEvent *event)
 {
-  XSelectionEvent event1;
-
-  if (selection_xwin_ == None || ! selection_set_)
-    return;
-
-  event1.type       = SelectionNotify;
-  event1.serial     = 0;
-  event1.send_event = True;
-  event1.display    = event->display;
-  event1.requestor  = event->requestor;
-  event1.selection  = event->selection;
-  event1.target     = event->target;
-  event1.time       = event->time;
-
-  if (event->target == XA_STRING) {
-    XChangeProperty(event->display, event->requestor, event->property,
-                    event->target, 8, PropModeReplace,
-                    reinterpret_cast<uchar *>(const_cast<char *>(selection_text_.c_str())),
-                    int(selection_text_.size()));
-
-    event1.property = event->property;
-  }
-  else {
-    event1.property = None;
-  }
-
-  XSendEvent(event->display, event->requestor, False, 0, reinterpret_cast<XEvent *>(&event1));
+  selection_->selectionRequestEvent(event);
 }
 
 void
 CXMachine::
 selectionNotifyEvent(XSelectionEvent *event)
 {
-  ulong  n;
-  Atom   type;
-  ulong  left;
-  uchar *data;
-  int    format;
-
-  selection_notify_received = true;
-
-  selection_text_ = "";
+  selection_->selectionNotifyEvent(event);
+}
 
-  if (XGetWindowProperty(event->display, event->requestor, event->selection,
-                         0, 256, False, event->target,
-                         &type, &format, &n, &left, &data) != Success)
-    return;
+// text of primary selection (waits handling only selection events)
+std::string
+CXMachine::
+selectionGetText(Window)
+{
+  std::string text;
 
-  if (! data)
-    return;
+  selection_->getText(XA_PRIMARY, text);
 
-  if (type != XA_STRING)
-    return;
+  return text;
+}
 
-  selection_xwin_ = getEventWindow(reinterpret_cast<XEvent *>(event));
-  selection_text_ = std::string(reinterpret_cast<char *>(data));
-  selection_set_  = true;
+bool
+CXMachine::
+clipboardSetText(Window xwin, const std::string &text)
+{
+  return selection_->setText(getAtom("CLIPBOARD").getXAtom(), xwin, text);
 }
 
 std::string
 CXMachine::
-selectionGetText(Window xwin)
+clipboardGetText(Window)
 {
-  XConvertSelection(display_, XA_PRIMARY, XA_STRING, XA_PRIMARY, xwin, CurrentTime);
+  std::string text;
 
-  selection_notify_received = false;
+  selection_->getText(getAtom("CLIPBOARD").getXAtom(), text);
 
-  while (! selection_notify_received) {
-    nextEvent();
-
-    processEvent();
-  }
-
-  return selection_text_;
+  return text;
 }
 
 const CXColor &
@@ -4298,7 +5418,8 @@ bool
 CXEventAdapter::
 idleEvent()
 {
-  COSTimer::msleep(10);
+  // no idle processing : let main loop block in waitForEvents
+  CXMachineInst->setIdleHandler(false);
 
   return true;
 }
@@ -4308,12 +5429,125 @@ idleEvent()
 CXFontList::
 CXFontList(const char *pattern, uint max_fonts)
 {
-  fonts_ = XListFonts(CXMachineInst->getDisplay(), pattern, int(max_fonts), &num_fonts_);
+  if (max_fonts > 0) {
+    addFonts(pattern, std::string::npos, int(std::min(max_fonts, uint(MAX_LIST_FONTS))));
+    return;
+  }
+
+  addFonts(pattern, 0, MAX_LIST_FONTS);
+
+  // split patterns can overlap
+  std::sort(fonts_.begin(), fonts_.end());
+
+  fonts_.erase(std::unique(fonts_.begin(), fonts_.end()), fonts_.end());
 }
 
+// add fonts matching pattern. If the request limit is reached the first
+// wildcard at or after pos is split into an empty match and a match starting
+// with each character (matching is case insensitive so only lower case
+// letters are used, '*' and '?' can't be matched literally)
+void
 CXFontList::
-~CXFontList()
+addFonts(const std::string &pattern, std::string::size_type pos, int max_names)
+{
+  Display *display = CXMachineInst->getDisplay();
+
+  int    num_fonts = 0;
+  char **fonts     = XListFonts(display, pattern.c_str(), max_names, &num_fonts);
+
+  std::string::size_type pos1 = pattern.find('*', pos);
+
+  if (num_fonts < max_names || pos1 == std::string::npos) {
+    for (int i = 0; i < num_fonts; ++i)
+      fonts_.push_back(fonts[i]);
+
+    if (fonts)
+      XFreeFontNames(fonts);
+
+    return;
+  }
+
+  XFreeFontNames(fonts);
+
+  std::string prefix = pattern.substr(0, pos1);
+  std::string rest   = pattern.substr(pos1 + 1);
+
+  addFonts(prefix + rest, pos1, max_names);
+
+  for (int c = 0x20; c <= 0xff; ++c) {
+    if (c == '*' || c == '?' || (c >= 'A' && c <= 'Z') || (c >= 0x7f && c < 0xa0) ||
+        (c >= 0xc0 && c <= 0xde && c != 0xd7))
+      continue;
+
+    addFonts(prefix + char(c) + "*" + rest, pos1 + 1, max_names);
+  }
+}
+
+//------------------
+
+static long long
+monotonicNSecs()
+{
+  timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return 1000000000LL*ts.tv_sec + ts.tv_nsec;
+}
+
+// frame timer fd expired : clear it and flag frame due
+static void
+frameTimerProc(CXMachine *, int fd, short, void *data)
 {
-  if (num_fonts_ > 0)
-    XFreeFontNames(fonts_);
+  uint64_t expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) < 0)
+    return;
+
+  *static_cast<bool *>(data) = true;
+}
+
+struct CXSameWindowMatch {
+  const XEvent *event   { nullptr };
+  bool          blocked { false };
+};
+
+// remove next queued event of same type for same window which is ahead of
+// any button or key event (so merged events keep their order with input)
+static bool
+checkSameWindowEvent(Display *display, const XEvent &event, XEvent *event1)
+{
+  CXSameWindowMatch match;
+
+  match.event = &event;
+
+  return XCheckIfEvent(display, event1, isSameWindowEvent, reinterpret_cast<XPointer>(&match));
+}
+
+// predicate for queued event of same type for same window (no match after
+// button or key event)
+static Bool
+isSameWindowEvent(Display *, XEvent *event, XPointer data)
+{
+  CXSameWindowMatch *match = reinterpret_cast<CXSameWindowMatch *>(data);
+
+  if (match->blocked)
+    return False;
+
+  if (event->type == ButtonPress || event->type == ButtonRelease ||
+      event->type == KeyPress    || event->type == KeyRelease) {
+    match->blocked = true;
+    return False;
+  }
+
+  const XEvent *event1 = match->event;
+
+  if (event->type != event1->type || event->xany.window != event1->xany.window)
+    return False;
+
+  // structure events for parent window have child in xconfigure.window
+  if (event->type == ConfigureNotify && event->xconfigure.window != event1->xconfigure.window)
+    return False;
+
+  return True;
 }
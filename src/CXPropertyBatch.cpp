@@ -0,0 +1,293 @@
+#include <CXPropertyBatch.h>
+#include <CXMachine.h>
+#include <CXAtom.h>
+
+#include <X11/Xlibint.h>
+#include <cstring>
+
+static Bool propertyReplyHandler(Display *display, xReply *rep, char *buf,
+                                 int len, XPointer data);
+
+CXPropertyBatch::
+CXPropertyBatch() :
+ display_(CXMachineInst->getDisplay())
+{
+}
+
+CXPropertyBatch::
+CXPropertyBatch(Display *display) :
+ display_(display)
+{
+}
+
+CXPropertyBatch::
+~CXPropertyBatch()
+{
+  wait();
+}
+
+uint
+CXPropertyBatch::
+add(Window xwin, const CXAtom &name, Atom type, long max_length,
+    CXPropertyProc proc, void *data)
+{
+  return add(xwin, name.getXAtom(), type, max_length, proc, data);
+}
+
+uint
+CXPropertyBatch::
+add(Window xwin, Atom name, Atom type, long max_length, CXPropertyProc proc, void *data)
+{
+  Request request;
+
+  request.max_length = max_length;
+  request.proc       = proc;
+  request.data       = data;
+
+  requests_.push_back(request);
+
+  CXPropertyReply reply;
+
+  reply.xwin = xwin;
+  reply.name = name;
+  reply.type = type; // requested type until reply arrives
+
+  replies_.push_back(reply);
+
+  return uint(replies_.size() - 1);
+}
+
+void
+CXPropertyBatch::
+send()
+{
+  // one batch in flight at a time
+  if (async_)
+    wait();
+
+  uint num = uint(requests_.size());
+
+  if (! display_ || num_sent_ >= num)
+    return;
+
+  // Xlib request macros use 'dpy'
+  Display *dpy = display_;
+
+  _XAsyncHandler *async = new _XAsyncHandler;
+
+  LockDisplay(dpy);
+
+  first_ = num_sent_;
+
+  for (uint i = num_sent_; i < num; ++i) {
+    const CXPropertyReply &reply = replies_[i];
+
+    xGetPropertyReq *req;
+
+    GetReq(GetProperty, req);
+
+    req->window     = reply.xwin;
+    req->property   = reply.name;
+    req->type       = reply.type;
+    req->c_delete   = False;
+    req->longOffset = 0;
+    req->longLength = requests_[i].max_length;
+
+    // requests are numbered consecutively while the display is locked
+    if (i == first_)
+      first_seq_ = X_DPY_GET_REQUEST(display_);
+  }
+
+  last_seq_ = X_DPY_GET_REQUEST(display_);
+
+  num_sent_ = num;
+
+  async->next    = display_->async_handlers;
+  async->handler = propertyReplyHandler;
+  async->data    = reinterpret_cast<XPointer>(this);
+
+  display_->async_handlers = async;
+
+  UnlockDisplay(dpy);
+
+  SyncHandle();
+
+  async_ = async;
+
+  XFlush(display_);
+}
+
+void
+CXPropertyBatch::
+wait()
+{
+  if (! async_)
+    return;
+
+  // the sync reply follows all property replies so they have all been
+  // passed to the handler when it returns
+  XSync(display_, False);
+
+  _XAsyncHandler *async = reinterpret_cast<_XAsyncHandler *>(async_);
+
+  LockDisplay(display_);
+
+  DeqAsyncHandler(display_, async);
+
+  UnlockDisplay(display_);
+
+  delete async;
+
+  async_ = nullptr;
+
+  for (uint i = first_; i < num_sent_; ++i) {
+    const Request &request = requests_[i];
+
+    if (request.proc)
+      request.proc(replies_[i], request.data);
+  }
+}
+
+void
+CXPropertyBatch::
+fetch()
+{
+  send();
+  wait();
+}
+
+void
+CXPropertyBatch::
+clear()
+{
+  wait();
+
+  requests_.clear();
+  replies_ .clear();
+
+  num_sent_ = 0;
+  first_    = 0;
+}
+
+bool
+CXPropertyBatch::
+handleReply(Display *display, void *rep, char *buf, int len)
+{
+  ulong seq = X_DPY_GET_LAST_REQUEST_READ(display);
+
+  if (seq < first_seq_ || seq > last_seq_)
+    return false;
+
+  CXPropertyReply &reply = replies_[first_ + uint(seq - first_seq_)];
+
+  xReply *xrep = reinterpret_cast<xReply *>(rep);
+
+  // consume errors (e.g. BadWindow for a window destroyed since the scan)
+  if (xrep->generic.type == X_Error) {
+    reply.type  = None;
+    reply.valid = false;
+    return true;
+  }
+
+  xGetPropertyReply replbuf;
+
+  xGetPropertyReply *repl = reinterpret_cast<xGetPropertyReply *>
+    (_XGetAsyncReply(display, reinterpret_cast<char *>(&replbuf), xrep, buf, len, 0, False));
+
+  reply.type        = repl->propertyType;
+  reply.format      = repl->format;
+  reply.num_items   = repl->nItems;
+  reply.bytes_after = repl->bytesAfter;
+  reply.valid       = true;
+
+  long nbytes = 0;
+
+  if (reply.type != None && reply.format > 0)
+    nbytes = long(reply.num_items*(reply.format/8));
+
+  reply.data.resize(size_t(nbytes + 1));
+
+  reply.data[size_t(nbytes)] = '\0';
+
+  if (repl->length > 0)
+    _XGetAsyncData(display, nbytes > 0 ? reinterpret_cast<char *>(&reply.data[0]) : nullptr,
+                   buf, len, SIZEOF(xGetPropertyReply), int(nbytes), int(repl->length << 2));
+
+  return true;
+}
+
+//------
+
+uint
+CXPropertyReply::
+getCard32(ulong i) const
+{
+  if (format != 32 || i >= num_items)
+    return 0;
+
+  uint32_t value;
+
+  memcpy(&value, &data[i*4], 4);
+
+  return value;
+}
+
+bool
+CXPropertyReply::
+getInteger(int *value) const
+{
+  if (! exists() || format != 32 || num_items == 0)
+    return false;
+
+  *value = int(getCard32(0));
+
+  return true;
+}
+
+bool
+CXPropertyReply::
+getString(std::string &value) const
+{
+  if (! exists() || format != 8 || num_items == 0)
+    return false;
+
+  value = std::string(reinterpret_cast<const char *>(&data[0]));
+
+  return true;
+}
+
+bool
+CXPropertyReply::
+getWindows(std::vector<Window> &windows) const
+{
+  if (! exists() || format != 32 || bytes_after != 0)
+    return false;
+
+  for (ulong i = 0; i < num_items; ++i)
+    windows.push_back(Window(getCard32(i)));
+
+  return true;
+}
+
+bool
+CXPropertyReply::
+getAtoms(std::vector<CXAtom> &atoms) const
+{
+  if (! exists() || format != 32 || bytes_after != 0)
+    return false;
+
+  for (ulong i = 0; i < num_items; ++i)
+    atoms.push_back(CXMachineInst->getAtom(Atom(getCard32(i))));
+
+  return true;
+}
+
+//------
+
+static Bool
+propertyReplyHandler(Display *display, xReply *rep, char *buf, int len, XPointer data)
+{
+  CXPropertyBatch *batch = reinterpret_cast<CXPropertyBatch *>(data);
+
+  return batch->handleReply(display, rep, buf, len) ? True : False;
+}
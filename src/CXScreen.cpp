@@ -3,6 +3,7 @@
 #include <CXWindow.h>
 #include <CXImage.h>
 #include <CXUtil.h>
+#include <CEnv.h>
 
 CXScreen::
 CXScreen(int screen_num) :
@@ -41,6 +42,12 @@ init()
     color_used_     .resize(uint(num_colors_));
     color_allocated_.resize(uint(num_colors_));
 
+    // components passed to rgbaIToPixel are 8 bit
+    red_mask_   = 0xFF;
+    green_mask_ = 0xFF;
+    blue_mask_  = 0xFF;
+    alpha_mask_ = 0xFF;
+
     setColorsUsed();
   }
   else {
@@ -58,6 +65,11 @@ init()
     alpha_mask_  = 0xFF;
   }
 
+  if      (CEnvInst.exists("CX_LIB_NO_DITHER"))
+    dither_type_ = CX_DITHER_NONE;
+  else if (CEnvInst.exists("CX_LIB_ORDERED_DITHER"))
+    dither_type_ = CX_DITHER_ORDERED;
+
   black_color_.setPixel(XBlackPixel(display_, screen_num_));
   white_color_.setPixel(XWhitePixel(display_, screen_num_));
 
@@ -183,6 +195,8 @@ setColormap(Colormap cmap)
 
   if (has_colormap_)
     setColorsUsed();
+  else if (color_mgr_)
+    color_mgr_->clearIndex();
 
   CXMachineInst->installColormap(cmap_);
 }
@@ -205,26 +219,26 @@ void
 CXScreen::
 addWindow(CXWindow *window)
 {
-  window_map_[window->getXWindow()] = window;
+  CXMachineInst->getWindowRegistry().addWindow(window->getXWindow(), window);
 }
 
 void
 CXScreen::
 removeWindow(CXWindow *window)
 {
-  window_map_[window->getXWindow()] = nullptr;
+  CXMachineInst->getWindowRegistry().removeWindow(window->getXWindow(), window);
 }
 
 CXWindow *
 CXScreen::
 lookupWindow(Window xwin)
 {
-  WindowMap::iterator p = window_map_.find(xwin);
+  CXWindow *window = CXMachineInst->getWindowRegistry().lookupWindow(xwin);
 
-  if (p != window_map_.end())
-    return (*p).second;
+  if (window && &window->getCXScreen() != this)
+    return nullptr;
 
-  return nullptr;
+  return window;
 }
 
 Pixel
@@ -281,115 +295,50 @@ rgbaIToPixel(uint red, uint green, uint blue, uint alpha)
     return pixel;
   }
 
-  int i;
-
-  if (! gray_scale_) {
-    uint red1   = (red   << 8) | red;
-    uint green1 = (green << 8) | green;
-    uint blue1  = (blue  << 8) | blue;
-
-    for (i = 0; i < num_colors_; ++i) {
-      if (color_used_[uint(i)] &&
-          colors_[uint(i)].red   == red1   &&
-          colors_[uint(i)].green == green1 &&
-          colors_[uint(i)].blue  == blue1)
-        return colors_[uint(i)].pixel;
-    }
-
-    if (num_used_colors_ < num_colors_) {
-      for (i = 0; i < num_colors_; ++i) {
-        if (! color_used_[uint(i)])
-          break;
-      }
-
-      color_used_[uint(i)] = true;
-
-      colors_[uint(i)].pixel = Pixel(i);
-      colors_[uint(i)].red   = ushort(red1);
-      colors_[uint(i)].green = ushort(green1);
-      colors_[uint(i)].blue  = ushort(blue1);
-      colors_[uint(i)].flags = DoRed | DoGreen | DoBlue;
-
-      XStoreColor(display_, cmap_, &colors_[uint(i)]);
-
-      CXMachineInst->flushEvents(true);
-
-      num_used_colors_++;
-
-      return colors_[uint(i)].pixel;
-    }
-
-    int nearest = 0;
-    int diff    = 256*256*256;
-    int diff1   = 0;
-
-    for (i = 0; i < num_colors_; ++i) {
-      uint cred1   = colors_[uint(i)].red   & 0x00FF;
-      uint cgreen1 = colors_[uint(i)].green & 0x00FF;
-      uint cblue1  = colors_[uint(i)].blue  & 0x00FF;
+  // gray scale colormap only uses red
+  if (gray_scale_) {
+    green = red;
+    blue  = red;
+  }
 
-      diff1 = std::abs(int(cred1  ) - int(red  ))*
-              std::abs(int(cgreen1) - int(green))*
-              std::abs(int(cblue1 ) - int(blue ));
+  uint key = (red << 16) | (green << 8) | blue;
 
-      if (diff1 < diff) {
-        nearest = i;
+  ColorIndexMap::const_iterator p = color_index_.find(key);
 
-        diff = diff1;
-      }
-    }
+  if (p != color_index_.end())
+    return colors_[uint((*p).second)].pixel;
 
-    return colors_[uint(nearest)].pixel;
-  }
-  else {
-    uint gray = (red << 8) | red;
+  if (num_used_colors_ < num_colors_) {
+    int i = free_color_;
 
-    for (i = 0; i < num_colors_; ++i) {
-      if (color_used_[uint(i)] && colors_[uint(i)].red == gray)
-        return colors_[uint(i)].pixel;
+    for ( ; i < num_colors_; ++i) {
+      if (! color_used_[uint(i)])
+        break;
     }
 
-    if (num_used_colors_ < num_colors_) {
-      for (i = 0; i < num_colors_; ++i) {
-        if (! color_used_[uint(i)])
-          break;
-      }
+    if (i < num_colors_) {
+      free_color_ = i + 1;
 
       color_used_[uint(i)] = true;
 
       colors_[uint(i)].pixel = Pixel(i);
-      colors_[uint(i)].red   = ushort(gray);
-      colors_[uint(i)].green = ushort(gray);
-      colors_[uint(i)].blue  = ushort(gray);
+      colors_[uint(i)].red   = ushort((red   << 8) | red  );
+      colors_[uint(i)].green = ushort((green << 8) | green);
+      colors_[uint(i)].blue  = ushort((blue  << 8) | blue );
       colors_[uint(i)].flags = DoRed | DoGreen | DoBlue;
 
+      // no sync needed, later requests using the pixel are ordered after the store
       XStoreColor(display_, cmap_, &colors_[uint(i)]);
 
-      CXMachineInst->flushEvents(true);
-
       num_used_colors_++;
 
-      return colors_[uint(i)].pixel;
-    }
-
-    int nearest = 0;
-    int diff    = 256;
-    int diff1   = 0;
-
-    for (i = 0; i < num_colors_; ++i) {
-      uint igray = (colors_[uint(i)].red & 0x00FF);
-
-      diff1 = std::abs(int(igray) - int(red));
-
-      if (diff1 < diff) {
-        nearest = i;
+      addColorIndex(i);
 
-        diff = diff1;
-      }
+      return colors_[uint(i)].pixel;
     }
-
-    return colors_[uint(nearest)].pixel;
   }
+
+  return colors_[uint(nearestColor(red, green, blue))].pixel;
 }
 
 void
@@ -423,20 +372,11 @@ pixelToRGBA(Pixel pixel)
   double alpha = 1;
 
   if (has_colormap_) {
-    int i;
-
-    for (i = 0; i < num_colors_; ++i) {
-      if (! color_used_[uint(i)])
-        continue;
-
-      if (colors_[uint(i)].pixel == pixel)
-        break;
-    }
-
-    if (i < num_colors_) {
-      red   = colors_[uint(i)].red  *rgb_scale;
-      green = colors_[uint(i)].green*rgb_scale;
-      blue  = colors_[uint(i)].blue *rgb_scale;
+    // cell index is pixel value
+    if (pixel < Pixel(num_colors_) && color_used_[uint(pixel)]) {
+      red   = colors_[uint(pixel)].red  *rgb_scale;
+      green = colors_[uint(pixel)].green*rgb_scale;
+      blue  = colors_[uint(pixel)].blue *rgb_scale;
     }
   }
   else {
@@ -578,6 +518,8 @@ setColorsUsed()
   for (int i = 0; i < num_colors_; ++i)
     if (color_used_[uint(i)])
       num_used_colors_++;
+
+  resetColorIndex();
 }
 
 void
@@ -601,6 +543,130 @@ freeAllocatedColors()
   }
 
   CXMachineInst->flushEvents(true);
+
+  resetColorIndex();
+}
+
+// rebuild exact match index from used cells (inverse map rebuilt on demand)
+void
+CXScreen::
+resetColorIndex()
+{
+  color_index_.clear();
+
+  for (int i = 0; i < num_colors_; ++i) {
+    if (color_used_[uint(i)])
+      addColorIndex(i);
+  }
+
+  free_color_ = 0;
+
+  inverse_valid_ = false;
+  dither_valid_  = false;
+
+  // cached color pixels may have been freed
+  if (color_mgr_)
+    color_mgr_->clearIndex();
+}
+
+// add used cell to exact match index and update nearest cell of inverse map
+void
+CXScreen::
+addColorIndex(int i)
+{
+  uint r = colors_[uint(i)].red   >> 8;
+  uint g = colors_[uint(i)].green >> 8;
+  uint b = colors_[uint(i)].blue  >> 8;
+
+  // first cell wins for duplicate colors
+  color_index_.emplace((r << 16) | (g << 8) | b, i);
+
+  if (! inverse_valid_)
+    return;
+
+  uint ind = 0;
+
+  for (uint ir = 0; ir < 32; ++ir) {
+    int dr = int((ir << 3) | 4) - int(r);
+
+    for (uint ig = 0; ig < 32; ++ig) {
+      int dg = int((ig << 3) | 4) - int(g);
+
+      for (uint ib = 0; ib < 32; ++ib, ++ind) {
+        int db = int((ib << 3) | 4) - int(b);
+
+        uint d = uint(dr*dr + dg*dg + db*db);
+
+        if (d < inverse_dist_[ind]) {
+          inverse_map_ [ind] = ushort(i);
+          inverse_dist_[ind] = d;
+        }
+      }
+    }
+  }
+}
+
+// allocate color cube cells once (nullptr if no colormap or gray scale)
+const CXDitherPalette *
+CXScreen::
+getDitherPalette()
+{
+  if (! has_colormap_ || gray_scale_)
+    return nullptr;
+
+  if (! dither_valid_) {
+    const int n = CXDitherPalette::LEVELS;
+
+    int ind = 0;
+
+    for (int ir = 0; ir < n; ++ir) {
+      uint r = uint(ir*255/(n - 1));
+
+      for (int ig = 0; ig < n; ++ig) {
+        uint g = uint(ig*255/(n - 1));
+
+        for (int ib = 0; ib < n; ++ib, ++ind) {
+          uint b = uint(ib*255/(n - 1));
+
+          // may be nearest existing cell if colormap is full
+          Pixel pixel = rgbaIToPixel(r, g, b, 0xFF);
+
+          const XColor &color = colors_[uint(pixel)];
+
+          dither_palette_.pixels[ind] = pixel;
+          dither_palette_.colors[ind] = (uint(color.red   >> 8) << 16) |
+                                        (uint(color.green >> 8) <<  8) |
+                                         uint(color.blue  >> 8);
+        }
+      }
+    }
+
+    dither_valid_ = true;
+  }
+
+  return &dither_palette_;
+}
+
+// nearest used cell to color (from 5 bits per channel inverse map)
+int
+CXScreen::
+nearestColor(uint r, uint g, uint b)
+{
+  if (! inverse_valid_) {
+    inverse_map_ .assign(32*32*32, 0);
+    inverse_dist_.assign(32*32*32, uint(-1));
+
+    inverse_valid_ = true;
+
+    for (int i = 0; i < num_colors_; ++i) {
+      if (! color_used_[uint(i)])
+        continue;
+
+      addColorIndex(i);
+    }
+  }
+
+  return inverse_map_[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
 }
 
 Pixmap
@@ -612,42 +678,29 @@ createMask(const CImagePtr &image)
   int width  = int(image->getWidth ());
   int height = int(image->getHeight());
 
-  Pixmap mask = XCreatePixmap(display_, xwindow, uint(width), uint(height), 1);
-
-  if (mask == None)
-    return None;
-
   CImagePtr image_mask = image->createMask();
 
-  GC gc = CXMachineInst->createGC(mask, 0, 0);
-
-  if (image_mask.isValid()) {
-    CXMachineInst->setForeground(gc, 0);
-
-    CXMachineInst->fillRectangle(mask, gc, 0, 0, width, height);
+  // pack mask into 1 bit per pixel rows (LSBFirst) and upload in one request
+  int bytes_per_line = (width + 7)/8;
 
-    CXMachineInst->setForeground(gc, 1);
+  std::vector<uchar> bits(size_t(std::max(bytes_per_line*height, 1)), 0);
 
+  if (image_mask.isValid()) {
     int pos = 0;
 
     for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x, ++pos) {
-        int pixel = image_mask->getColorIndexPixel(pos);
+      uchar *row = &bits[size_t(y*bytes_per_line)];
 
-        if (pixel != 0)
-          CXMachineInst->drawPoint(mask, gc, x, y);
+      for (int x = 0; x < width; ++x, ++pos) {
+        if (image_mask->getColorIndexPixel(pos) != 0)
+          row[x >> 3] |= uchar(1 << (x & 7));
       }
     }
   }
-  else {
-    CXMachineInst->setForeground(gc, 1);
-
-    CXMachineInst->fillRectangle(mask, gc, 0, 0, width, height);
-  }
-
-  CXMachineInst->freeGC(gc);
+  else
+    std::fill(bits.begin(), bits.end(), uchar(0xFF));
 
-  return mask;
+  return CXMachineInst->createXBitmap(xwindow, &bits[0], uint(width), uint(height));
 }
 
 void
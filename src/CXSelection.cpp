@@ -0,0 +1,956 @@
+#include <CXSelection.h>
+#include <CXMachine.h>
+#include <CXAtom.h>
+
+#include <X11/Xatom.h>
+#include <poll.h>
+#include <time.h>
+#include <algorithm>
+#include <cstring>
+
+static long long   monotonicMSecs();
+static std::string utf8ToLatin1(const std::string &str);
+static std::string latin1ToUtf8(const std::string &str);
+static void        copyDataProc(const CXSelectionData &data, void *client_data);
+static Bool        isSelectionEventProc(Display *display, XEvent *event, XPointer data);
+
+CXSelection::
+CXSelection(CXMachine &machine) :
+ machine_(machine)
+{
+}
+
+CXSelection::
+~CXSelection()
+{
+  resetDisplay();
+}
+
+bool
+CXSelection::
+setText(Atom selection, Window xwin, const std::string &text, Time time)
+{
+  Owner *owner = takeOwnership(selection, xwin, time);
+
+  if (! owner)
+    return false;
+
+  owner->targets.clear();
+
+  DataP utf8_data   = std::make_shared<const std::string>(text);
+  DataP latin1_data = std::make_shared<const std::string>(utf8ToLatin1(text));
+
+  Atom utf8_string = getAtom("UTF8_STRING");
+
+  Target utf8_target;
+
+  utf8_target.type = utf8_string;
+  utf8_target.data = utf8_data;
+
+  Target latin1_target;
+
+  latin1_target.type = XA_STRING;
+  latin1_target.data = latin1_data;
+
+  owner->targets[utf8_string]                         = utf8_target;
+  owner->targets[getAtom("TEXT")]                     = utf8_target;
+  owner->targets[getAtom("text/plain;charset=utf-8")] = utf8_target;
+  owner->targets[XA_STRING]                           = latin1_target;
+
+  return true;
+}
+
+bool
+CXSelection::
+setData(Atom selection, Window xwin, Atom target, const std::string &data, Time time)
+{
+  Owner *owner = nullptr;
+
+  Owners::iterator p = owners_.find(selection);
+
+  if (p != owners_.end() && (*p).second.xwin == xwin)
+    owner = &(*p).second;
+  else
+    owner = takeOwnership(selection, xwin, time);
+
+  if (! owner)
+    return false;
+
+  Target target1;
+
+  target1.type = target;
+  target1.data = std::make_shared<const std::string>(data);
+
+  owner->targets[target] = target1;
+
+  return true;
+}
+
+void
+CXSelection::
+reset(Atom selection)
+{
+  Owners::iterator p = owners_.find(selection);
+
+  if (p == owners_.end())
+    return;
+
+  owners_.erase(p);
+
+  Display *display = machine_.getDisplay();
+
+  if (display)
+    XSetSelectionOwner(display, selection, None, CurrentTime);
+}
+
+bool
+CXSelection::
+isOwner(Atom selection) const
+{
+  return (owners_.find(selection) != owners_.end());
+}
+
+Window
+CXSelection::
+getOwner(Atom selection) const
+{
+  Owners::const_iterator p = owners_.find(selection);
+
+  if (p == owners_.end())
+    return None;
+
+  return (*p).second.xwin;
+}
+
+CXSelection::Owner *
+CXSelection::
+takeOwnership(Atom selection, Window xwin, Time time)
+{
+  Display *display = machine_.getDisplay();
+
+  if (! display)
+    return nullptr;
+
+  XSetSelectionOwner(display, selection, xwin, time);
+
+  if (XGetSelectionOwner(display, selection) != xwin) {
+    owners_.erase(selection);
+    return nullptr;
+  }
+
+  Owner &owner = owners_[selection];
+
+  owner.xwin = xwin;
+  owner.time = time;
+
+  return &owner;
+}
+
+// value of owned selection for target (TARGETS and TIMESTAMP are generated)
+bool
+CXSelection::
+getTarget(const Owner &owner, Atom target, Target &data) const
+{
+  if      (target == getAtom("TARGETS")) {
+    std::vector<uint32_t> atoms;
+
+    atoms.push_back(uint32_t(getAtom("TARGETS")));
+    atoms.push_back(uint32_t(getAtom("TIMESTAMP")));
+
+    for (const auto &target1 : owner.targets)
+      atoms.push_back(uint32_t(target1.first));
+
+    data.type   = XA_ATOM;
+    data.format = 32;
+    data.data   = std::make_shared<const std::string>
+                    (reinterpret_cast<const char *>(&atoms[0]), 4*atoms.size());
+  }
+  else if (target == getAtom("TIMESTAMP")) {
+    uint32_t time = uint32_t(owner.time);
+
+    data.type   = XA_INTEGER;
+    data.format = 32;
+    data.data   = std::make_shared<const std::string>(reinterpret_cast<const char *>(&time), 4);
+  }
+  else {
+    Targets::const_iterator p = owner.targets.find(target);
+
+    if (p == owner.targets.end())
+      return false;
+
+    data = (*p).second;
+  }
+
+  return true;
+}
+
+//------
+
+bool
+CXSelection::
+selectionRequestEvent(const XSelectionRequestEvent *event)
+{
+  XSelectionEvent event1;
+
+  event1.type       = SelectionNotify;
+  event1.serial     = 0;
+  event1.send_event = True;
+  event1.display    = event->display;
+  event1.requestor  = event->requestor;
+  event1.selection  = event->selection;
+  event1.target     = event->target;
+  event1.property   = None;
+  event1.time       = event->time;
+
+  // refuse (property None) if not owner or target not available
+  Owners::const_iterator p = owners_.find(event->selection);
+
+  if (p != owners_.end()) {
+    const Owner &owner = (*p).second;
+
+    // obsolete requestors use target as property
+    Atom property = (event->property != None ? event->property : event->target);
+
+    Target target;
+
+    if (getTarget(owner, event->target, target)) {
+      if (sendTarget(event->requestor, property, target))
+        event1.property = property;
+    }
+  }
+
+  // requestor may have been destroyed
+  machine_.trapStart();
+
+  XSendEvent(event->display, event->requestor, False, 0, reinterpret_cast<XEvent *>(&event1));
+
+  machine_.trapEndAsync();
+
+  return true;
+}
+
+bool
+CXSelection::
+selectionClearEvent(const XSelectionClearEvent *event)
+{
+  Owners::iterator p = owners_.find(event->selection);
+
+  if (p == owners_.end() || (*p).second.xwin != event->window)
+    return false;
+
+  owners_.erase(p);
+
+  return true;
+}
+
+// store target value on requestor property (INCR if larger than a request).
+// Requestor may be destroyed at any time so its requests are trapped
+bool
+CXSelection::
+sendTarget(Window requestor, Atom property, const Target &target)
+{
+  Display *display = machine_.getDisplay();
+
+  const std::string &data = *target.data;
+
+  machine_.trapStart();
+
+  if (target.format == 32) {
+    std::vector<long> values(data.size()/4);
+
+    for (size_t i = 0; i < values.size(); ++i) {
+      uint32_t value;
+
+      memcpy(&value, &data[4*i], 4);
+
+      values[i] = long(value);
+    }
+
+    XChangeProperty(display, requestor, property, target.type, 32, PropModeReplace,
+                    reinterpret_cast<uchar *>(values.empty() ? nullptr : &values[0]),
+                    int(values.size()));
+
+    machine_.trapEndAsync();
+
+    return true;
+  }
+
+  if (data.size() <= getChunkSize()) {
+    XChangeProperty(display, requestor, property, target.type, 8, PropModeReplace,
+                    reinterpret_cast<const uchar *>(data.c_str()), int(data.size()));
+
+    machine_.trapEndAsync();
+
+    return true;
+  }
+
+  // INCR : announce size then send a chunk each time requestor deletes property
+  IncrSend send;
+
+  send.requestor = requestor;
+  send.property  = property;
+  send.target    = target;
+  send.deadline  = monotonicMSecs() + DEFAULT_TIMEOUT;
+
+  uint event_mask = machine_.getWindowEventMask(requestor);
+
+  if (! (event_mask & PropertyChangeMask)) {
+    machine_.selectInput(requestor, event_mask | PropertyChangeMask);
+
+    send.restore_mask = event_mask;
+    send.restore      = true;
+  }
+
+  long size = long(data.size());
+
+  XChangeProperty(display, requestor, property, getAtom("INCR"), 32, PropModeReplace,
+                  reinterpret_cast<uchar *>(&size), 1);
+
+  // no transfer if requestor has gone
+  if (! machine_.trapEnd())
+    return false;
+
+  sends_.push_back(send);
+
+  return true;
+}
+
+// send next chunk (returns false if requestor has gone)
+bool
+CXSelection::
+sendIncrChunk(IncrSend &send)
+{
+  const std::string &data = *send.target.data;
+
+  size_t n = std::min(getChunkSize(), data.size() - send.pos);
+
+  machine_.trapStart();
+
+  XChangeProperty(machine_.getDisplay(), send.requestor, send.property, send.target.type,
+                  8, PropModeReplace, reinterpret_cast<const uchar *>(data.c_str() + send.pos),
+                  int(n));
+
+  send.pos     += n;
+  send.deadline = monotonicMSecs() + DEFAULT_TIMEOUT;
+
+  return machine_.trapEnd();
+}
+
+void
+CXSelection::
+endIncrSend(size_t i)
+{
+  IncrSend send = sends_[i];
+
+  sends_.erase(sends_.begin() + long(i));
+
+  if (! send.restore)
+    return;
+
+  // restore event mask once last transfer to window is done
+  for (const auto &send1 : sends_) {
+    if (send1.requestor == send.requestor)
+      return;
+  }
+
+  machine_.trapStart();
+
+  machine_.selectInput(send.requestor, send.restore_mask);
+
+  machine_.trapEndAsync();
+}
+
+//------
+
+uint
+CXSelection::
+request(Atom selection, Atom target, CXSelectionProc proc, void *client_data,
+        int timeout_msecs)
+{
+  Request request;
+
+  request.id               = ++request_id_;
+  request.timeout          = timeout_msecs;
+  request.deadline         = monotonicMSecs() + timeout_msecs;
+  request.proc             = proc;
+  request.client_data      = client_data;
+  request.result.selection = selection;
+  request.result.target    = target;
+
+  // convert locally if we are the owner
+  Owners::const_iterator p = owners_.find(selection);
+
+  if (p != owners_.end()) {
+    Target target1;
+
+    if (getTarget((*p).second, target, target1)) {
+      request.result.type   = target1.type;
+      request.result.format = target1.format;
+      request.result.data   = *target1.data;
+      request.result.valid  = true;
+    }
+
+    if (proc)
+      proc(request.result, client_data);
+
+    return request.id;
+  }
+
+  Display *display = machine_.getDisplay();
+
+  Window xwin = getRequestorWindow();
+
+  if (! display || xwin == None) {
+    if (proc)
+      proc(request.result, client_data);
+
+    return request.id;
+  }
+
+  request.property = getRequestProperty();
+
+  XConvertSelection(display, selection, target, request.property, xwin, CurrentTime);
+
+  XFlush(display);
+
+  requests_.push_back(request);
+
+  return request.id;
+}
+
+void
+CXSelection::
+cancel(uint id)
+{
+  for (size_t i = 0; i < requests_.size(); ++i) {
+    if (requests_[i].id == id) {
+      requests_.erase(requests_.begin() + long(i));
+      return;
+    }
+  }
+}
+
+bool
+CXSelection::
+isPending(uint id) const
+{
+  for (const auto &request : requests_) {
+    if (request.id == id)
+      return true;
+  }
+
+  return false;
+}
+
+void
+CXSelection::
+wait(uint id)
+{
+  Display *display = machine_.getDisplay();
+
+  if (! display)
+    return;
+
+  while (isPending(id)) {
+    XEvent event;
+
+    if (XCheckIfEvent(display, &event, isSelectionEventProc,
+                      reinterpret_cast<XPointer>(this))) {
+      dispatchEvent(&event);
+      continue;
+    }
+
+    checkTimeouts();
+
+    if (! isPending(id))
+      break;
+
+    XFlush(display);
+
+    pollfd fds[1];
+
+    fds[0].fd      = ConnectionNumber(display);
+    fds[0].events  = POLLIN;
+    fds[0].revents = 0;
+
+    if (poll(fds, 1, getTimeout(-1)) > 0)
+      XEventsQueued(display, QueuedAfterReading);
+  }
+}
+
+bool
+CXSelection::
+getText(Atom selection, std::string &text, int timeout_msecs)
+{
+  Atom targets[2] = { getAtom("UTF8_STRING"), XA_STRING };
+
+  for (const auto &target : targets) {
+    CXSelectionData result;
+
+    uint id = request(selection, target, copyDataProc, &result, timeout_msecs);
+
+    wait(id);
+
+    if (result.valid && result.format == 8) {
+      if (result.type == XA_STRING)
+        text = latin1ToUtf8(result.data);
+      else
+        text = result.data;
+
+      return true;
+    }
+
+    // owner not responding
+    if (result.timed_out)
+      break;
+  }
+
+  return false;
+}
+
+bool
+CXSelection::
+selectionNotifyEvent(const XSelectionEvent *event)
+{
+  if (requestor_xwin_ == None || event->requestor != requestor_xwin_)
+    return false;
+
+  // match oldest pending conversion of selection and target
+  for (size_t i = 0; i < requests_.size(); ++i) {
+    Request &request = requests_[i];
+
+    if (request.incr || request.result.selection != event->selection ||
+        request.result.target != event->target)
+      continue;
+
+    if (event->property == None) {
+      completeRequest(i, false);
+      return true;
+    }
+
+    request.result.data.clear();
+
+    if (readProperty(requestor_xwin_, request.property, request.result) < 0) {
+      completeRequest(i, false);
+      return true;
+    }
+
+    if (request.result.type == getAtom("INCR")) {
+      // property deleted by read so owner starts sending chunks
+      request.incr     = true;
+      request.deadline = monotonicMSecs() + request.timeout;
+
+      request.result.data.clear();
+
+      return true;
+    }
+
+    completeRequest(i, true);
+
+    return true;
+  }
+
+  return true;
+}
+
+bool
+CXSelection::
+propertyNotifyEvent(const XPropertyEvent *event)
+{
+  // INCR receive : new chunk on our property (empty chunk ends transfer)
+  if (requestor_xwin_ != None && event->window == requestor_xwin_) {
+    if (event->state != PropertyNewValue)
+      return true;
+
+    for (size_t i = 0; i < requests_.size(); ++i) {
+      Request &request = requests_[i];
+
+      if (! request.incr || request.property != event->atom)
+        continue;
+
+      long n = readProperty(requestor_xwin_, request.property, request.result);
+
+      if      (n < 0)
+        completeRequest(i, false);
+      else if (n == 0)
+        completeRequest(i, true);
+      else
+        request.deadline = monotonicMSecs() + request.timeout;
+
+      break;
+    }
+
+    return true;
+  }
+
+  // INCR send : requestor deleted property so send next chunk
+  if (event->state != PropertyDelete)
+    return false;
+
+  for (size_t i = 0; i < sends_.size(); ++i) {
+    IncrSend &send = sends_[i];
+
+    if (send.requestor != event->window || send.property != event->atom)
+      continue;
+
+    bool last = (send.pos >= send.target.data->size());
+
+    // requestor gone : drop transfer (no event mask to restore)
+    if (! sendIncrChunk(send)) {
+      sends_.erase(sends_.begin() + long(i));
+      return true;
+    }
+
+    if (last)
+      endIncrSend(i);
+
+    return true;
+  }
+
+  return false;
+}
+
+bool
+CXSelection::
+isSelectionEvent(const XEvent *event) const
+{
+  switch (event->type) {
+    case SelectionRequest:
+      return true;
+    case SelectionNotify:
+      return (requestor_xwin_ != None && event->xselection.requestor == requestor_xwin_);
+    case PropertyNotify: {
+      if (requestor_xwin_ != None && event->xproperty.window == requestor_xwin_)
+        return true;
+
+      for (const auto &send : sends_) {
+        if (send.requestor == event->xproperty.window && send.property == event->xproperty.atom)
+          return true;
+      }
+
+      return false;
+    }
+    default:
+      return false;
+  }
+}
+
+void
+CXSelection::
+dispatchEvent(XEvent *event)
+{
+  switch (event->type) {
+    case SelectionRequest:
+      selectionRequestEvent(&event->xselectionrequest);
+      break;
+    case SelectionNotify:
+      selectionNotifyEvent(&event->xselection);
+      break;
+    case PropertyNotify:
+      propertyNotifyEvent(&event->xproperty);
+      break;
+    default:
+      break;
+  }
+}
+
+//------
+
+int
+CXSelection::
+getTimeout(int timeout_msecs) const
+{
+  if (requests_.empty() && sends_.empty())
+    return timeout_msecs;
+
+  long long deadline = -1;
+
+  for (const auto &request : requests_) {
+    if (deadline < 0 || request.deadline < deadline)
+      deadline = request.deadline;
+  }
+
+  for (const auto &send : sends_) {
+    if (deadline < 0 || send.deadline < deadline)
+      deadline = send.deadline;
+  }
+
+  int timeout = int(std::max(deadline - monotonicMSecs(), 0LL));
+
+  if (timeout_msecs < 0)
+    return timeout;
+
+  return std::min(timeout, timeout_msecs);
+}
+
+void
+CXSelection::
+checkTimeouts()
+{
+  if (requests_.empty() && sends_.empty())
+    return;
+
+  long long now = monotonicMSecs();
+
+  for (size_t i = 0; i < requests_.size(); ) {
+    if (requests_[i].deadline <= now)
+      completeRequest(i, false, true);
+    else
+      ++i;
+  }
+
+  for (size_t i = 0; i < sends_.size(); ) {
+    if (sends_[i].deadline <= now)
+      endIncrSend(i);
+    else
+      ++i;
+  }
+}
+
+//------
+
+void
+CXSelection::
+completeRequest(size_t i, bool valid, bool timed_out)
+{
+  // remove before callback as it may make new requests
+  Request request = requests_[i];
+
+  requests_.erase(requests_.begin() + long(i));
+
+  request.result.valid     = valid;
+  request.result.timed_out = timed_out;
+
+  if (! valid)
+    request.result.data.clear();
+
+  if (request.proc)
+    request.proc(request.result, request.client_data);
+}
+
+// append property value (deleting it), returns bytes read or -1 on error
+long
+CXSelection::
+readProperty(Window xwin, Atom property, CXSelectionData &result)
+{
+  Display *display = machine_.getDisplay();
+
+  long offset = 0;
+  long nread  = 0;
+
+  while (true) {
+    Atom   type;
+    int    format;
+    ulong  n, left;
+    uchar *data = nullptr;
+
+    if (XGetWindowProperty(display, xwin, property, offset, 0x10000, True,
+                           AnyPropertyType, &type, &format, &n, &left, &data) != Success)
+      return -1;
+
+    if (type == None) {
+      if (data)
+        XFree(data);
+
+      return (offset > 0 ? nread : -1);
+    }
+
+    result.type   = type;
+    result.format = format;
+
+    if (format == 32) {
+      // Xlib returns 32 bit items as longs
+      for (ulong i = 0; i < n; ++i) {
+        uint32_t value = uint32_t(reinterpret_cast<long *>(data)[i]);
+
+        result.data.append(reinterpret_cast<const char *>(&value), 4);
+      }
+
+      nread  += long(4*n);
+      offset += long(n);
+    }
+    else {
+      size_t bytes = n*size_t(format/8);
+
+      result.data.append(reinterpret_cast<const char *>(data), bytes);
+
+      nread  += long(bytes);
+      offset += long(bytes/4);
+    }
+
+    XFree(data);
+
+    if (left == 0)
+      break;
+  }
+
+  return nread;
+}
+
+void
+CXSelection::
+resetDisplay()
+{
+  Display *display = machine_.getDisplay();
+
+  if (display && requestor_xwin_ != None)
+    XDestroyWindow(display, requestor_xwin_);
+
+  owners_  .clear();
+  sends_   .clear();
+  requests_.clear();
+
+  requestor_xwin_ = None;
+}
+
+// hidden window receiving converted selections
+Window
+CXSelection::
+getRequestorWindow()
+{
+  if (requestor_xwin_ != None)
+    return requestor_xwin_;
+
+  Display *display = machine_.getDisplay();
+
+  if (! display)
+    return None;
+
+  XSetWindowAttributes attr;
+
+  attr.event_mask = PropertyChangeMask;
+
+  requestor_xwin_ = XCreateWindow(display, DefaultRootWindow(display), -1, -1, 1, 1, 0,
+                                  CopyFromParent, InputOnly, nullptr, CWEventMask, &attr);
+
+  return requestor_xwin_;
+}
+
+// property not used by a pending request
+Atom
+CXSelection::
+getRequestProperty()
+{
+  for (int i = 0; ; ++i) {
+    std::string name = "_CXLIB_SELECTION_" + std::to_string(i);
+
+    Atom property = getAtom(name.c_str());
+
+    bool used = false;
+
+    for (const auto &request : requests_) {
+      if (request.property == property) {
+        used = true;
+        break;
+      }
+    }
+
+    if (! used)
+      return property;
+  }
+}
+
+Atom
+CXSelection::
+getAtom(const char *name) const
+{
+  return machine_.getAtom(name).getXAtom();
+}
+
+// largest property chunk sent in one request
+size_t
+CXSelection::
+getChunkSize() const
+{
+  Display *display = machine_.getDisplay();
+
+  long max_size = XExtendedMaxRequestSize(display);
+
+  if (max_size <= 0)
+    max_size = XMaxRequestSize(display);
+
+  // request size is in 4 byte units, allow for request header
+  size_t size = size_t(max_size)*4 - 100;
+
+  return std::min(size, size_t(1 << 18));
+}
+
+//------
+
+static long long
+monotonicMSecs()
+{
+  timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return 1000LL*ts.tv_sec + ts.tv_nsec/1000000;
+}
+
+// characters outside Latin-1 become '?'
+static std::string
+utf8ToLatin1(const std::string &str)
+{
+  std::string str1;
+
+  size_t len = str.size();
+
+  for (size_t i = 0; i < len; ) {
+    uchar c = uchar(str[i]);
+
+    if      (c < 0x80) {
+      str1 += char(c);
+
+      ++i;
+    }
+    else if ((c & 0xE0) == 0xC0 && i + 1 < len) {
+      uint code = ((c & 0x1F) << 6) | (uchar(str[i + 1]) & 0x3F);
+
+      str1 += (code < 0x100 ? char(code) : '?');
+
+      i += 2;
+    }
+    else {
+      str1 += '?';
+
+      // skip continuation bytes of multi byte character
+      for (++i; i < len && (uchar(str[i]) & 0xC0) == 0x80; ++i)
+        ;
+    }
+  }
+
+  return str1;
+}
+
+static std::string
+latin1ToUtf8(const std::string &str)
+{
+  std::string str1;
+
+  for (const auto &c : str) {
+    uchar c1 = uchar(c);
+
+    if (c1 < 0x80)
+      str1 += char(c1);
+    else {
+      str1 += char(0xC0 | (c1 >> 6));
+      str1 += char(0x80 | (c1 & 0x3F));
+    }
+  }
+
+  return str1;
+}
+
+static void
+copyDataProc(const CXSelectionData &data, void *client_data)
+{
+  *static_cast<CXSelectionData *>(client_data) = data;
+}
+
+static Bool
+isSelectionEventProc(Display *, XEvent *event, XPointer data)
+{
+  CXSelection *selection = reinterpret_cast<CXSelection *>(data);
+
+  return selection->isSelectionEvent(event) ? True : False;
+}
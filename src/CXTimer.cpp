@@ -8,6 +8,8 @@ class CXTimer1 : public CTimer {
   CXTimer1(CXTimer *timer, uint msecs, CTimerFlags flags);
  ~CXTimer1();
 
+  static bool hasTimers() { return ! timers_.empty(); }
+
  private:
   static std::list<CXTimer1 *> timers_;
 
@@ -35,6 +37,13 @@ restart()
   timer_->restart();
 }
 
+bool
+CXTimer::
+hasTimers()
+{
+  return CXTimer1::hasTimers();
+}
+
 CXTimer1::
 CXTimer1(CXTimer *timer, uint msecs, CTimerFlags flags) :
  CTimer(msecs, flags), timer_(timer)
@@ -2,6 +2,10 @@
 #include <CStrUtil.h>
 #include <cstring>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void
 CXUtil::
 decodeVisualMask(uint full_mask, int *shift, uint *mask)
@@ -118,3 +122,123 @@ encodeXFontName(const std::string &name, CFontStyle style, int size)
 
   return font_name;
 }
+
+bool
+CXUtil::
+isHostLSBFirst()
+{
+  uint i = 1;
+
+  return (*reinterpret_cast<uchar *>(&i) == 1);
+}
+
+// ARGB <-> ABGR in place
+void
+CXUtil::
+swapRedBlue(uint *argb, int n)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i ag_mask = _mm_set1_epi32(int(0xFF00FF00));
+  const __m128i b_mask  = _mm_set1_epi32(0x000000FF);
+
+  for ( ; i + 4 <= n; i += 4) {
+    __m128i *p = reinterpret_cast<__m128i *>(argb + i);
+
+    __m128i p1 = _mm_loadu_si128(p);
+
+    __m128i ag = _mm_and_si128(p1, ag_mask);
+    __m128i r  = _mm_and_si128(_mm_srli_epi32(p1, 16), b_mask);
+    __m128i b  = _mm_slli_epi32(_mm_and_si128(p1, b_mask), 16);
+
+    _mm_storeu_si128(p, _mm_or_si128(ag, _mm_or_si128(r, b)));
+  }
+#endif
+
+  for ( ; i < n; ++i) {
+    uint p1 = argb[i];
+
+    argb[i] = (p1 & 0xFF00FF00) | ((p1 >> 16) & 0xFF) | ((p1 & 0xFF) << 16);
+  }
+}
+
+// composite src over dst for 8 bit per channel pixels (alpha in top byte of src)
+//   c = (s*a + d*(255 - a))/255
+void
+CXUtil::
+blendARGB(uint *dst, const uint *src, int n)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c255 = _mm_set1_epi16(255);
+  const __m128i c128 = _mm_set1_epi16(128);
+
+  auto blend2 = [&](__m128i s, __m128i d) {
+    __m128i a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a),
+                              _mm_mullo_epi16(d, _mm_sub_epi16(c255, a)));
+
+    t = _mm_add_epi16(t, c128);
+
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  };
+
+  for ( ; i + 4 <= n; i += 4) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+
+    __m128i lo = blend2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+    __m128i hi = blend2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+  }
+#endif
+
+  for ( ; i < n; ++i) {
+    uint s = src[i];
+    uint d = dst[i];
+
+    uint a  = s >> 24;
+    uint ia = 255 - a;
+
+    uint p = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+      uint t = ((s >> shift) & 0xFF)*a + ((d >> shift) & 0xFF)*ia + 128;
+
+      p |= (((t + (t >> 8)) >> 8) & 0xFF) << shift;
+    }
+
+    dst[i] = p;
+  }
+}
+
+// scale color channels by alpha (as required for render pictures)
+void
+CXUtil::
+premultiplyARGB(uint *argb, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    uint p = argb[i];
+    uint a = p >> 24;
+
+    if (a == 255)
+      continue;
+
+    uint q = p & 0xFF000000;
+
+    for (int shift = 0; shift < 24; shift += 8) {
+      uint t = ((p >> shift) & 0xFF)*a + 128;
+
+      q |= (((t + (t >> 8)) >> 8) & 0xFF) << shift;
+    }
+
+    argb[i] = q;
+  }
+}
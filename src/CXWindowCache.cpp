@@ -0,0 +1,149 @@
+#include <CXWindowCache.h>
+#include <X11/Xatom.h>
+
+void
+CXWindowCache::
+setEnabled(bool enabled)
+{
+  enabled_ = enabled;
+
+  if (! enabled_)
+    clear();
+}
+
+CXWindowCache::Entry *
+CXWindowCache::
+getEntry(Window xwin)
+{
+  if (! enabled_)
+    return nullptr;
+
+  EntryMap::iterator p = entries_.find(xwin);
+
+  if (p == entries_.end())
+    return nullptr;
+
+  return &(*p).second;
+}
+
+CXWindowCache::Entry *
+CXWindowCache::
+setAttributes(Window xwin, const XWindowAttributes &attr)
+{
+  if (! enabled_)
+    return nullptr;
+
+  // without structure events we would never hear about changes
+  if (! (attr.your_event_mask & StructureNotifyMask)) {
+    removeEntry(xwin);
+    return nullptr;
+  }
+
+  Entry &entry = entries_[xwin];
+
+  entry.attr       = attr;
+  entry.attr_valid = true;
+  entry.map_serial = map_serial_;
+  entry.properties = (attr.your_event_mask & PropertyChangeMask);
+
+  if (! entry.properties) {
+    entry.name_valid  = false;
+    entry.icon_valid  = false;
+    entry.class_valid = false;
+  }
+
+  return &entry;
+}
+
+bool
+CXWindowCache::
+isAttrValid(const Entry *entry, bool map_state) const
+{
+  if (! entry || ! entry->attr_valid)
+    return false;
+
+  // map state also depends on ancestors so any map change makes it stale
+  if (map_state && entry->map_serial != map_serial_)
+    return false;
+
+  return true;
+}
+
+void
+CXWindowCache::
+removeEntry(Window xwin)
+{
+  entries_.erase(xwin);
+}
+
+void
+CXWindowCache::
+invalidateGeometry(Window xwin)
+{
+  Entry *entry = getEntry(xwin);
+
+  if (entry) {
+    entry->attr_valid   = false;
+    entry->parent_valid = false;
+  }
+}
+
+void
+CXWindowCache::
+invalidateProperty(Window xwin, Atom atom)
+{
+  Entry *entry = getEntry(xwin);
+
+  if (! entry)
+    return;
+
+  if      (atom == XA_WM_NAME)
+    entry->name_valid = false;
+  else if (atom == XA_WM_ICON_NAME)
+    entry->icon_valid = false;
+  else if (atom == XA_WM_CLASS)
+    entry->class_valid = false;
+}
+
+void
+CXWindowCache::
+processEvent(const XEvent &event)
+{
+  if (! enabled_ || entries_.empty())
+    return;
+
+  switch (event.type) {
+    case ConfigureNotify:
+      invalidateGeometry(event.xconfigure.window);
+      break;
+    case GravityNotify:
+      // moved by parent resize (win_gravity)
+      invalidateGeometry(event.xgravity.window);
+      break;
+    case MapNotify:
+    case UnmapNotify:
+      invalidateMapState();
+      break;
+    case ReparentNotify:
+      invalidateGeometry(event.xreparent.window);
+      invalidateMapState();
+      break;
+    case DestroyNotify:
+      removeEntry(event.xdestroywindow.window);
+      break;
+    case PropertyNotify:
+      invalidateProperty(event.xproperty.window, event.xproperty.atom);
+      break;
+    default:
+      break;
+  }
+}
+
+void
+CXWindowCache::
+clear()
+{
+  entries_.clear();
+
+  invalidateMapState();
+}
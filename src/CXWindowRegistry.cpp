@@ -0,0 +1,153 @@
+#include <CXWindowRegistry.h>
+#include <cstdint>
+
+static uint hashWindow(Window xwin);
+
+void
+CXWindowRegistry::
+addWindow(Window xwin, CXWindow *window)
+{
+  if (xwin == None)
+    return;
+
+  // keep load factor at most 1/2
+  if (2*(num_ + 1) > slots_.size())
+    grow();
+
+  uint i = findSlot(xwin);
+
+  if (slots_[i].xwin == None) {
+    slots_[i].xwin = xwin;
+
+    ++num_;
+  }
+
+  slots_[i].window = window;
+
+  last_xwin_   = xwin;
+  last_window_ = window;
+}
+
+// remove window (only if still registered for the XID)
+void
+CXWindowRegistry::
+removeWindow(Window xwin, CXWindow *window)
+{
+  if (xwin == None || slots_.empty())
+    return;
+
+  uint i = findSlot(xwin);
+
+  if (slots_[i].xwin == None || slots_[i].window != window)
+    return;
+
+  if (last_xwin_ == xwin) {
+    last_xwin_   = None;
+    last_window_ = nullptr;
+  }
+
+  // shift back following entries of the probe sequence into the hole
+  uint mask = uint(slots_.size() - 1);
+
+  uint j = i;
+
+  while (true) {
+    j = (j + 1) & mask;
+
+    if (slots_[j].xwin == None)
+      break;
+
+    uint k = hashWindow(slots_[j].xwin) & mask;
+
+    // entry stays if its home slot is cyclically in (i, j]
+    bool stay = (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+
+    if (stay)
+      continue;
+
+    slots_[i] = slots_[j];
+
+    i = j;
+  }
+
+  slots_[i] = Slot();
+
+  --num_;
+}
+
+CXWindow *
+CXWindowRegistry::
+lookupWindow(Window xwin) const
+{
+  if (xwin == None)
+    return nullptr;
+
+  if (xwin == last_xwin_)
+    return last_window_;
+
+  if (slots_.empty())
+    return nullptr;
+
+  const Slot &slot = slots_[findSlot(xwin)];
+
+  if (slot.xwin == None)
+    return nullptr;
+
+  last_xwin_   = xwin;
+  last_window_ = slot.window;
+
+  return slot.window;
+}
+
+// slot holding xwin or empty slot where it would go
+uint
+CXWindowRegistry::
+findSlot(Window xwin) const
+{
+  uint mask = uint(slots_.size() - 1);
+
+  uint i = hashWindow(xwin) & mask;
+
+  while (slots_[i].xwin != None && slots_[i].xwin != xwin)
+    i = (i + 1) & mask;
+
+  return i;
+}
+
+void
+CXWindowRegistry::
+grow()
+{
+  std::vector<Slot> slots;
+
+  slots.swap(slots_);
+
+  slots_.resize(std::max(size_t(64), 2*slots.size()));
+
+  num_ = 0;
+
+  for (const auto &slot : slots) {
+    if (slot.xwin == None)
+      continue;
+
+    slots_[findSlot(slot.xwin)] = slot;
+
+    ++num_;
+  }
+}
+
+//------
+
+// XIDs are client base | sequential id, mix all bits into low bits
+static uint
+hashWindow(Window xwin)
+{
+  // mix in 64 bits (Window may be 32 bit)
+  uint64_t h = xwin;
+
+  h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+
+  return uint(h);
+}
@@ -1,12 +1,62 @@
 #include <CXrtFont.h>
+#include <CXMachine.h>
 #include <CPixelRenderer.h>
 
 #include <std_Xt.h>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
 
 #define XRT_CHAR_BORDER_RIGHT 3
 
 using std::string;
 
+static uint64_t transpose8x8(uint64_t m);
+static void     transposeBits(const uchar *src, int w, int h, uchar *dst,
+                              bool flip_src, bool flip_dst);
+
+CXrtFontP
+CXrtFont::
+lookup(Display *display, Window window, const string &name, double angle)
+{
+  typedef std::tuple<Display *, Window, string, int> Key;
+  typedef std::map<Key, std::weak_ptr<CXrtFont> >    FontMap;
+
+  static FontMap fonts;
+
+  int iangle = int(angle) % 360;
+
+  if (iangle < 0)
+    iangle += 360;
+
+  Key key(display, window, name, iangle);
+
+  FontMap::iterator p = fonts.find(key);
+
+  if (p != fonts.end()) {
+    CXrtFontP font = (*p).second.lock();
+
+    if (font)
+      return font;
+  }
+
+  // drop entries of released fonts
+  for (p = fonts.begin(); p != fonts.end(); ) {
+    if ((*p).second.expired())
+      p = fonts.erase(p);
+    else
+      ++p;
+  }
+
+  CXrtFontP font(new CXrtFont(display, window, name, iangle));
+
+  fonts[key] = font;
+
+  return font;
+}
+
 CXrtFont::
 CXrtFont(Display *display, const string &name, double angle) :
  display_(display), window_(None), angle_(int(angle)), name_(name)
@@ -39,14 +89,6 @@ CXrtFont(Display *display, Window window, XFontStruct *fs, double angle) :
   init();
 }
 
-CXrtFont::
-CXrtFont(const CXrtFont &xrt_font) :
- display_(xrt_font.display_), window_(xrt_font.window_),
- angle_(xrt_font.angle_), name_(xrt_font.name_), fs_(xrt_font.fs_)
-{
-  init();
-}
-
 CXrtFont::
 ~CXrtFont()
 {
@@ -56,16 +98,11 @@ CXrtFont::
   if (pixmap1_ != None)
     XFreePixmap(display_, pixmap1_);
 
-  if (pixmap2_ != pixmap1_)
+  if (pixmap2_ != None)
     XFreePixmap(display_, pixmap2_);
 
-  if (ximage_)
-    XDestroyImage(ximage_);
-
   if (gc_)
     XFreeGC(display_, gc_);
-
-  delete [] rotated_;
 }
 
 void
@@ -93,11 +130,19 @@ init()
   while (angle_ >= 360)
     angle_ -= 360;
 
+  // exact values for right angles so glyphs stay pixel aligned
+  if      (angle_ ==   0) { cos_ =  1.0; sin_ =  0.0; }
+  else if (angle_ ==  90) { cos_ =  0.0; sin_ =  1.0; }
+  else if (angle_ == 180) { cos_ = -1.0; sin_ =  0.0; }
+  else if (angle_ == 270) { cos_ =  0.0; sin_ = -1.0; }
+  else {
+    cos_ = std::cos(angle_*M_PI/180.0);
+    sin_ = std::sin(angle_*M_PI/180.0);
+  }
+
   pixmap1_ = None;
   pixmap2_ = None;
 
-  ximage_ = NULL;
-
   width_   = 0;
   ascent_  = 0;
   descent_ = 0;
@@ -121,22 +166,51 @@ init()
 
   width_ += 4;
 
-  int (*error_handler)(Display *, XErrorEvent *) =
-    XSetErrorHandler(CXrtFont::XErrorHandler);
+  initAdvances();
 
-  pixmap1_ = XCreatePixmap(display_, window_,
-                           uint(num_chars_*width_), uint(ascent_ + descent_), 1);
+  int h = ascent_ + descent_;
 
-  if      (angle_ == 90 || angle_ == 270)
-    pixmap2_ = XCreatePixmap(display_, window_,
-                             uint(ascent_ + descent_), uint(num_chars_*width_), 1);
-  else if (angle_ == 180)
-    pixmap2_ = XCreatePixmap(display_, window_,
-                             uint(num_chars_*width_), uint(ascent_ + descent_), 1);
-  else
-    pixmap2_ = pixmap1_;
+  // rotated glyphs are stored in a grid of cells big enough for any glyph
+  int ax, ay;
+
+  getRotatedRect(width_, h, &ax, &ay, &atlas_width_, &atlas_height_);
+
+  atlas_cols_ = std::max(std::min(num_chars_, 16), 1);
+
+  int atlas_rows = (num_chars_ + atlas_cols_ - 1)/atlas_cols_;
+
+  glyphs_.clear();
+
+  glyphs_.resize(size_t(num_chars_));
+
+  // on pixmap creation error (e.g. too large) no glyphs are drawn
+  CXMachineInst->trapStart();
+
+  // glyphs are rasterized by the server into pixmap1_ (one cell per char)
+  pixmap1_ = XCreatePixmap(display_, window_, uint(num_chars_*width_), uint(h), 1);
 
-  XSetErrorHandler(error_handler);
+  // rotated glyph atlas (unrotated text is drawn directly from font)
+  if (angle_ != 0)
+    pixmap2_ = XCreatePixmap(display_, window_, uint(atlas_cols_*atlas_width_),
+                             uint(atlas_rows*atlas_height_), 1);
+
+  if (! CXMachineInst->trapEnd()) {
+    // free whichever pixmap was created (error for other is ignored)
+    CXMachineInst->trapStart();
+
+    if (pixmap1_ != None)
+      XFreePixmap(display_, pixmap1_);
+
+    if (pixmap2_ != None)
+      XFreePixmap(display_, pixmap2_);
+
+    CXMachineInst->trapEndAsync();
+
+    pixmap1_ = None;
+    pixmap2_ = None;
+
+    return;
+  }
 
   XGCValues gc_values;
 
@@ -150,24 +224,11 @@ init()
 
   XSetForeground(display_, gc_, 0);
 
-  if      (angle_ == 90 || angle_ == 270)
-    XFillRectangle(display_, pixmap2_, gc_, 0, 0,
-                   uint(ascent_ + descent_), uint(num_chars_*width_));
-  else if (angle_ == 180)
-    XFillRectangle(display_, pixmap2_, gc_, 0, 0,
-                   uint(num_chars_*width_), uint(ascent_ + descent_));
-
-  XFillRectangle(display_, pixmap1_, gc_, 0, 0,
-                 uint(num_chars_*width_), uint(ascent_ + descent_));
+  XFillRectangle(display_, pixmap1_, gc_, 0, 0, uint(num_chars_*width_), uint(h));
 
   XSetForeground(display_, gc_, 1);
 
   XSetFont(display_, gc_, fs_->fid);
-
-  rotated_ = new bool [uint(num_chars_)];
-
-  for (int i = 0; i < num_chars_; i++)
-    rotated_[i] = false;
 }
 
 void
@@ -195,16 +256,8 @@ void
 CXrtFont::
 textExtents(const string &str, int *width, int *ascent, int *descent)
 {
-  int         ascent1;
-  XCharStruct overall;
-  int         descent1;
-  int         direction;
-
-  XTextExtents(fs_, const_cast<char *>(str.c_str()), int(str.size()),
-               &direction, &ascent1, &descent1, &overall);
-
   if (width != NULL)
-    *width = overall.width;
+    *width = getStringWidth(str);
 
   if (ascent != NULL)
     *ascent = ascent_;
@@ -213,255 +266,201 @@ textExtents(const string &str, int *width, int *ascent, int *descent)
     *descent = descent_;
 }
 
+// build advance of each 8 bit char, using Xlib's rules (missing chars use
+// default char, or zero if that is also missing)
 void
 CXrtFont::
-draw(Window window, GC gc, int x, int y, const string &str)
+initAdvances()
 {
-  bool changed = false;
+  // matrix (2 byte) fonts are measured by Xlib
+  advances_valid_ = (fs_->min_byte1 == 0 && fs_->max_byte1 == 0);
 
-  auto len = str.size();
+  fixed_advance_ = -1;
 
-  for (size_t i = 0; i < len; i++) {
-    int c = str[i];
-
-    if (c < 0 || c >= num_chars_)
-      continue;
-
-    if (! rotated_[c - start_char_]) {
-      rotateChar(c);
-
-      changed = true;
-    }
-  }
-
-  if (changed || ximage_ == NULL) {
-    if (ximage_ != NULL)
-      XDestroyImage(ximage_);
-
-    if (angle_ == 0 || angle_ == 180)
-      ximage_ = XGetImage(display_, pixmap2_, 0, 0, uint(num_chars_*width_),
-                          uint(ascent_ + descent_), AllPlanes, XYPixmap);
-    else
-      ximage_ = XGetImage(display_, pixmap2_, 0, 0, uint(ascent_ + descent_),
-                          uint(num_chars_*width_), AllPlanes, XYPixmap);
-  }
-
-  if (ximage_ == NULL)
+  if (! advances_valid_)
     return;
 
-  len = str.size();
-
-  for (size_t i = 0; i < len; i++) {
-    int c = str[i] - start_char_;
+  auto charAdvance = [&](uint c, int *w) {
+    if (c < fs_->min_char_or_byte2 || c > fs_->max_char_or_byte2)
+      return false;
 
-    if (c < 0 || c >= num_chars_)
-      continue;
+    if (! fs_->per_char) {
+      *w = fs_->max_bounds.width;
+      return true;
+    }
 
-    int wc;
+    const XCharStruct &cs = fs_->per_char[c - fs_->min_char_or_byte2];
 
-    if (fs_->per_char)
-      wc = fs_->per_char[c].width;
-    else
-      wc = fs_->min_bounds.width;
+    if (cs.width == 0 && (cs.rbearing | cs.lbearing | cs.ascent | cs.descent) == 0)
+      return false;
 
-    if      (angle_ == 90) {
-      int ys = (num_chars_ - 1 - c)*width_;
-      int yd = y - wc - XRT_CHAR_BORDER_RIGHT;
+    *w = cs.width;
 
-      for (int yy = 0; yy < wc + XRT_CHAR_BORDER_RIGHT; yy++, ys++, yd++) {
-        int xs = 0;
-        int xd = x;
+    return true;
+  };
 
-        for (int xx = 0; xx < ascent_ + descent_; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+  for (uint c = 0; c < 256; c++) {
+    int w = 0;
 
-          if (pixel != 0)
-            XDrawPoint(display_, window, gc, xd, yd);
-        }
-      }
-
-      y -= wc;
-    }
-    else if (angle_ == 270) {
-      int ys = c*width_;
-      int yd = y;
+    if (! charAdvance(c, &w) && ! charAdvance(fs_->default_char, &w))
+      w = 0;
 
-      for (int yy = 0; yy < wc + XRT_CHAR_BORDER_RIGHT; yy++, ys++, yd++) {
-        int xs = 0;
-        int xd = x - ascent_ - descent_;
+    advances_[c] = w;
+  }
 
-        for (int xx = 0; xx < ascent_ + descent_; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+  // constant width font (all chars including missing ones have same advance)
+  if (fs_->min_bounds.width == fs_->max_bounds.width) {
+    fixed_advance_ = advances_[0];
 
-          if (pixel != 0)
-            XDrawPoint(display_, window, gc, xd, yd);
-        }
+    for (uint c = 1; c < 256; c++) {
+      if (advances_[c] != fixed_advance_) {
+        fixed_advance_ = -1;
+        break;
       }
-
-      y += wc;
     }
-    else if (angle_ == 180) {
-      int ys = 0;
-      int yd = y - ascent_ - descent_;
+  }
+}
 
-      for (int yy = 0; yy < ascent_ + descent_; yy++, ys++, yd++) {
-        int xs = (num_chars_ - 1 - c)*width_;
-        int xd = x - wc - XRT_CHAR_BORDER_RIGHT;
+int
+CXrtFont::
+getCharAdvance(uchar c) const
+{
+  if (advances_valid_)
+    return advances_[c];
 
-        for (int xx = 0; xx < wc + XRT_CHAR_BORDER_RIGHT; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+  char c1 = char(c);
 
-          if (pixel != 0)
-            XDrawPoint(display_, window, gc, xd, yd);
-        }
-      }
+  return XTextWidth(fs_, &c1, 1);
+}
 
-      x -= wc;
-    }
-    else {
-      int ys = 0;
-      int yd = y;
+int
+CXrtFont::
+getStringWidth(const string &str) const
+{
+  if (! advances_valid_)
+    return XTextWidth(fs_, const_cast<char *>(str.c_str()), int(str.size()));
 
-      for (int yy = 0; yy < ascent_ + descent_; yy++, ys++, yd++) {
-        int xs = c*width_;
-        int xd = x;
+  if (fixed_advance_ >= 0)
+    return int(str.size())*fixed_advance_;
 
-        for (int xx = 0; xx < wc + XRT_CHAR_BORDER_RIGHT; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+  int width = 0;
 
-          if (pixel != 0)
-            XDrawPoint(display_, window, gc, xd, yd);
-        }
-      }
+  for (auto c : str)
+    width += advances_[uchar(c)];
 
-      x += wc;
-    }
-  }
+  return width;
 }
 
+// draw text (top left at x, y). Unrotated text is drawn by the server from
+// the font, rotated glyphs are filled through the glyph atlas as stipple
+// (one fill per glyph)
 void
 CXrtFont::
-draw(CPixelRenderer *renderer, int x, int y, const string &str)
+draw(Window window, GC gc, int x, int y, const string &str)
 {
-  bool changed = false;
+  if (str.empty())
+    return;
 
-  auto len = str.size();
+  if (angle_ == 0) {
+    // restore caller's font (Xlib returns an id with top bits set if never set)
+    XGCValues font_values;
 
-  for (size_t i = 0; i < len; i++) {
-    int c = str[i];
+    XGetGCValues(display_, gc, GCFont, &font_values);
 
-    if (c < 0 || c >= num_chars_)
-      continue;
+    XSetFont(display_, gc, fs_->fid);
 
-    if (! rotated_[c - start_char_]) {
-      rotateChar(c);
+    XDrawString(display_, window, gc, x, y + ascent_,
+                const_cast<char *>(str.c_str()), int(str.size()));
 
-      changed = true;
-    }
-  }
+    if ((font_values.font & 0xE0000000) == 0 && font_values.font != fs_->fid)
+      XSetFont(display_, gc, font_values.font);
 
-  if (changed || ximage_ == NULL) {
-    if (ximage_ != NULL)
-      XDestroyImage(ximage_);
-
-    if (angle_ == 0 || angle_ == 180)
-      ximage_ = XGetImage(display_, pixmap2_, 0, 0,
-                          uint(num_chars_*width_), uint(ascent_ + descent_), AllPlanes, XYPixmap);
-    else
-      ximage_ = XGetImage(display_, pixmap2_, 0, 0,
-                          uint(ascent_ + descent_), uint(num_chars_*width_), AllPlanes, XYPixmap);
+    return;
   }
 
-  if (ximage_ == NULL)
+  if (pixmap2_ == None)
     return;
 
-  len = str.size();
+  rotateChars(str);
 
-  for (size_t i = 0; i < len; i++) {
-    int c = str[i] - start_char_;
+  XGCValues gc_values;
 
-    if (c < 0 || c >= num_chars_)
-      continue;
+  XGetGCValues(display_, gc, GCFillStyle | GCStipple | GCTileStipXOrigin | GCTileStipYOrigin,
+               &gc_values);
 
-    int wc;
+  XSetStipple  (display_, gc, pixmap2_);
+  XSetFillStyle(display_, gc, FillStippled);
 
-    if (fs_->per_char)
-      wc = fs_->per_char[c].width;
-    else
-      wc = fs_->min_bounds.width;
+  double px = x;
+  double py = y;
+
+  auto len = str.size();
+
+  for (size_t i = 0; i < len; i++) {
+    int c = uchar(str[i]) - start_char_;
 
-    if      (angle_ == 90) {
-      int ys = (num_chars_ - 1 - c)*width_;
-      int yd = y - wc - XRT_CHAR_BORDER_RIGHT;
+    if (c < 0 || c >= num_chars_)
+      continue;
 
-      for (int yy = 0; yy < wc + XRT_CHAR_BORDER_RIGHT; yy++, ys++, yd++) {
-        int xs = 0;
-        int xd = x;
+    const Glyph &glyph = glyphs_[size_t(c)];
 
-        for (int xx = 0; xx < ascent_ + descent_; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+    if (glyph.valid && glyph.width > 0 && glyph.height > 0) {
+      int xd = int(std::lround(px)) + glyph.dx;
+      int yd = int(std::lround(py)) + glyph.dy;
 
-          if (pixel != 0)
-            renderer->drawPoint(CIPoint2D(xd, yd));
-        }
-      }
+      // stipple origin places glyph's atlas cell at destination
+      XSetTSOrigin(display_, gc, xd - glyph.ax, yd - glyph.ay);
 
-      y -= wc;
+      XFillRectangle(display_, window, gc, xd, yd, uint(glyph.width), uint(glyph.height));
     }
-    else if (angle_ == 270) {
-      int ys = c*width_;
-      int yd = y;
 
-      for (int yy = 0; yy < wc + XRT_CHAR_BORDER_RIGHT; yy++, ys++, yd++) {
-        int xs = 0;
-        int xd = x - ascent_ - descent_;
+    int wc = getCharWidth(c);
 
-        for (int xx = 0; xx < ascent_ + descent_; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+    px += wc*cos_;
+    py -= wc*sin_;
+  }
 
-          if (pixel != 0)
-            renderer->drawPoint(CIPoint2D(xd, yd));
-        }
-      }
+  XSetFillStyle(display_, gc, gc_values.fill_style);
+  XSetTSOrigin (display_, gc, gc_values.ts_x_origin, gc_values.ts_y_origin);
 
-      y += wc;
-    }
-    else if (angle_ == 180) {
-      int ys = 0;
-      int yd = y - ascent_ - descent_;
+  // default stipple is returned as an invalid id (top bits set)
+  if ((gc_values.stipple & 0xE0000000) == 0)
+    XSetStipple(display_, gc, gc_values.stipple);
+}
 
-      for (int yy = 0; yy < ascent_ + descent_; yy++, ys++, yd++) {
-        int xs = (num_chars_ - 1 - c)*width_;
-        int xd = x - wc - XRT_CHAR_BORDER_RIGHT;
+void
+CXrtFont::
+draw(CPixelRenderer *renderer, int x, int y, const string &str)
+{
+  rotateChars(str);
 
-        for (int xx = 0; xx < wc + XRT_CHAR_BORDER_RIGHT; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+  double px = x;
+  double py = y;
 
-          if (pixel != 0)
-            renderer->drawPoint(CIPoint2D(xd, yd));
-        }
-      }
+  auto len = str.size();
 
-      x -= wc;
-    }
-    else {
-      int ys = 0;
-      int yd = y;
+  for (size_t i = 0; i < len; i++) {
+    int c = uchar(str[i]) - start_char_;
 
-      for (int yy = 0; yy < ascent_ + descent_; yy++, ys++, yd++) {
-        int xs = c*width_;
-        int xd = x;
+    if (c < 0 || c >= num_chars_)
+      continue;
 
-        for (int xx = 0; xx < wc + XRT_CHAR_BORDER_RIGHT; xx++, xs++, xd++) {
-          Pixel pixel = XGetPixel(ximage_, xs, ys);
+    const Glyph &glyph = glyphs_[size_t(c)];
 
-          if (pixel != 0)
-            renderer->drawPoint(CIPoint2D(xd, yd));
-        }
-      }
+    if (glyph.valid) {
+      int xd = int(std::lround(px)) + glyph.dx;
+      int yd = int(std::lround(py)) + glyph.dy;
 
-      x += wc;
+      for (int yy = 0; yy < glyph.height; yy++)
+        for (int xx = 0; xx < glyph.width; xx++)
+          if (glyph.getBit(xx, yy))
+            renderer->drawPoint(CIPoint2D(xd + xx, yd + yy));
     }
+
+    int wc = getCharWidth(c);
+
+    px += wc*cos_;
+    py -= wc*sin_;
   }
 }
 
@@ -469,57 +468,55 @@ void
 CXrtFont::
 drawImage(Window window, GC gc, int x, int y, const string &str)
 {
-  XGCValues gc_values;
+  int h = ascent_ + descent_;
 
-  XGetGCValues(display_, gc, GCForeground | GCBackground, &gc_values);
+  std::vector<XRectangle> rects;
 
-  XSetForeground(display_, gc, gc_values.background);
+  rects.reserve(str.size());
 
-  int x1 = x;
-  int y1 = y;
+  double px = x;
+  double py = y;
 
   auto len = str.size();
 
   for (size_t i = 0; i < len; i++) {
-    int c = str[i] - start_char_;
+    int c = uchar(str[i]) - start_char_;
 
     if (c < 0 || c >= num_chars_)
       continue;
 
-    int wc;
+    int wc = getCharWidth(c);
 
-    if (fs_->per_char)
-      wc = fs_->per_char[c].width;
-    else
-      wc = fs_->min_bounds.width;
+    // bounding box of rotated char cell
+    int rx, ry, rw, rh;
 
-    if      (angle_ == 90) {
-      XFillRectangle(display_, window, gc, x1, y1 - wc,
-                     uint(ascent_ + descent_), uint(wc));
+    getRotatedRect(wc, h, &rx, &ry, &rw, &rh);
 
-      y1 -= wc;
-    }
-    else if (angle_ == 270) {
-      XFillRectangle(display_, window, gc, x1 - ascent_ - descent_, y1,
-                     uint(ascent_ + descent_), uint(wc));
+    XRectangle rect;
 
-      y1 += wc;
-    }
-    else if (angle_ == 180) {
-      XFillRectangle(display_, window, gc, x1 - wc, y1 - ascent_ - descent_,
-                     uint(wc), uint(ascent_ + descent_));
+    rect.x      = short(std::lround(px) + rx);
+    rect.y      = short(std::lround(py) + ry);
+    rect.width  = ushort(rw);
+    rect.height = ushort(rh);
 
-      x1 -= wc;
-    }
-    else {
-      XFillRectangle(display_, window, gc, x1, y1,
-                     uint(wc), uint(ascent_ + descent_));
+    rects.push_back(rect);
 
-      x1 += wc;
-    }
+    px += wc*cos_;
+    py -= wc*sin_;
   }
 
-  XSetForeground(display_, gc, gc_values.foreground);
+  // background of all glyphs in one request
+  if (! rects.empty()) {
+    XGCValues gc_values;
+
+    XGetGCValues(display_, gc, GCForeground | GCBackground, &gc_values);
+
+    XSetForeground(display_, gc, gc_values.background);
+
+    XFillRectangles(display_, window, gc, &rects[0], int(rects.size()));
+
+    XSetForeground(display_, gc, gc_values.foreground);
+  }
 
   draw(window, gc, x, y, str);
 }
@@ -535,104 +532,215 @@ drawImage(CPixelRenderer *renderer, int x, int y, const string &str)
 
   renderer->setForeground(bg);
 
-  int x1 = x;
-  int y1 = y;
+  int h = ascent_ + descent_;
+
+  double px = x;
+  double py = y;
 
   auto len = str.size();
 
   for (size_t i = 0; i < len; i++) {
-    int c = str[i] - start_char_;
+    int c = uchar(str[i]) - start_char_;
 
     if (c < 0 || c >= num_chars_)
       continue;
 
-    int wc;
+    int wc = getCharWidth(c);
 
-    if (fs_->per_char)
-      wc = fs_->per_char[c].width;
-    else
-      wc = fs_->min_bounds.width;
+    int rx, ry, rw, rh;
 
-    if      (angle_ == 90) {
-      renderer->fillRectangle(CIBBox2D(x1, y1 - wc, ascent_ + descent_, wc));
+    getRotatedRect(wc, h, &rx, &ry, &rw, &rh);
 
-      y1 -= wc;
-    }
-    else if (angle_ == 270) {
-      renderer->fillRectangle(CIBBox2D(x1 - ascent_ - descent_, y1, ascent_ + descent_, wc));
+    renderer->fillRectangle(CIBBox2D(int(std::lround(px)) + rx, int(std::lround(py)) + ry, rw, rh));
 
-      y1 += wc;
-    }
-    else if (angle_ == 180) {
-      renderer->fillRectangle(CIBBox2D(x1 - wc, y1 - ascent_ - descent_, wc, ascent_ + descent_));
+    px += wc*cos_;
+    py -= wc*sin_;
+  }
 
-      x1 -= wc;
-    }
-    else {
-      renderer->fillRectangle(CIBBox2D(x1, y1, wc, ascent_ + descent_));
+  renderer->setForeground(fg);
+
+  draw(renderer, x, y, str);
+}
+
+// rasterize glyphs of string not yet cached. New glyphs are drawn into
+// pixmap1_ and only the cells spanning them are read back (one round trip),
+// returns true if any glyph was added
+bool
+CXrtFont::
+rotateChars(const string &str)
+{
+  if (pixmap1_ == None)
+    return false;
+
+  int c1 = num_chars_;
+  int c2 = -1;
+
+  auto len = str.size();
+
+  for (size_t i = 0; i < len; i++) {
+    int c = uchar(str[i]) - start_char_;
+
+    if (c < 0 || c >= num_chars_ || glyphs_[size_t(c)].valid)
+      continue;
 
-      x1 += wc;
+    // draw each new char once
+    if (str.find(str[i]) == i) {
+      char c3 = str[i];
+
+      XDrawString(display_, pixmap1_, gc_, c*width_, ascent_, &c3, 1);
     }
+
+    c1 = std::min(c1, c);
+    c2 = std::max(c2, c);
   }
 
-  renderer->setForeground(fg);
+  if (c2 < 0)
+    return false;
 
-  draw(renderer, x, y, str);
+  XImage *ximage = XGetImage(display_, pixmap1_, c1*width_, 0, uint((c2 - c1 + 1)*width_),
+                             uint(ascent_ + descent_), 1, XYPixmap);
+
+  if (! ximage)
+    return false;
+
+  for (size_t i = 0; i < len; i++) {
+    int c = uchar(str[i]) - start_char_;
+
+    if (c < 0 || c >= num_chars_ || glyphs_[size_t(c)].valid)
+      continue;
+
+    rotateGlyph(c, ximage, (c - c1)*width_);
+  }
+
+  XDestroyImage(ximage);
+
+  return true;
 }
 
+// build glyph bitmap from char cell at x in ximage. Right angles are
+// rotated exactly with bit transposes, other angles are resampled
 void
 CXrtFont::
-rotateChar(int c)
+rotateGlyph(int c1, XImage *ximage, int x)
 {
-  int c1 = c - start_char_;
+  Glyph &glyph = glyphs_[size_t(c1)];
 
-  int x1 = c1*width_;
+  int w = getCharWidth(c1) + XRT_CHAR_BORDER_RIGHT;
+  int h = ascent_ + descent_;
 
-  int x2 = 0;
+  glyph.valid = true;
 
-  if      (angle_ == 90)
-    x2 = (num_chars_ - c1)*width_ - 1;
-  else if (angle_ == 270)
-    x2 = c1*width_;
-  else if (angle_ == 180)
-    x2 = (num_chars_ - c1)*width_ - 1;
+  if (w <= 0 || h <= 0)
+    return;
 
-  int wc1;
+  int bpl = (w + 7)/8;
 
-  if (fs_->per_char)
-    wc1 = fs_->per_char[c1].width;
-  else
-    wc1 = fs_->min_bounds.width;
+  std::vector<uchar> bits(size_t(bpl*h), 0);
+
+  for (int yy = 0; yy < h; yy++)
+    for (int xx = 0; xx < w; xx++)
+      if (XGetPixel(ximage, x + xx, yy))
+        bits[size_t(yy*bpl + xx/8)] |= uchar(1 << (xx & 7));
 
-  int xo = width_ - wc1;
+  getRotatedRect(w, h, &glyph.dx, &glyph.dy, &glyph.width, &glyph.height);
 
-  char c2 = char(c);
+  int dbpl = (glyph.width + 7)/8;
 
-  XDrawString(display_, pixmap1_, gc_, x1, ascent_, &c2, 1);
+  glyph.bits.assign(size_t(dbpl*glyph.height), 0);
 
-  int char_width  = wc1;
-  int char_height = ascent_ + descent_;
+  if      (angle_ == 0)
+    glyph.bits.swap(bits);
+  else if (angle_ == 90)
+    transposeBits(&bits[0], w, h, &glyph.bits[0], false, true);
+  else if (angle_ == 270)
+    transposeBits(&bits[0], w, h, &glyph.bits[0], true, false);
+  else if (angle_ == 180) {
+    std::vector<uchar> bits1(size_t(((h + 7)/8)*w), 0);
 
-  if      (angle_ == 90) {
-    for (int y = 0; y < char_height; y++)
-      for (int x = 0; x < char_width + XRT_CHAR_BORDER_RIGHT; x++)
-        XCopyPlane(display_, pixmap1_, pixmap2_, gc_, x1 + x, y, 1, 1,
-                   y, x2 - x - xo + XRT_CHAR_BORDER_RIGHT, 1);
+    transposeBits(&bits [0], w, h, &bits1[0]      , false, true);
+    transposeBits(&bits1[0], h, w, &glyph.bits[0], false, true);
   }
-  else if (angle_ == 270) {
-    for (int y = 0; y < char_height; y++)
-      for (int x = 0; x < char_width + XRT_CHAR_BORDER_RIGHT; x++)
-        XCopyPlane(display_, pixmap1_, pixmap2_, gc_, x1 + x, y, 1, 1,
-                   char_height - y - 1, x2 + x, 1);
+  else {
+    // sample source at center of each destination pixel (inverse rotation)
+    for (int yy = 0; yy < glyph.height; yy++) {
+      double py = glyph.dy + yy + 0.5;
+
+      for (int xx = 0; xx < glyph.width; xx++) {
+        double px = glyph.dx + xx + 0.5;
+
+        int u = int(std::floor(px*cos_ - py*sin_));
+        int v = int(std::floor(px*sin_ + py*cos_));
+
+        if (u < 0 || u >= w || v < 0 || v >= h)
+          continue;
+
+        if (bits[size_t(v*bpl + u/8)] & (1 << (u & 7)))
+          glyph.bits[size_t(yy*dbpl + xx/8)] |= uchar(1 << (xx & 7));
+      }
+    }
   }
-  else if (angle_ == 180) {
-    for (int y = 0; y < char_height; y++)
-      for (int x = 0; x < char_width + XRT_CHAR_BORDER_RIGHT; x++)
-        XCopyPlane(display_, pixmap1_, pixmap2_, gc_, x1 + x, y, 1, 1,
-                   x2 - x - xo + XRT_CHAR_BORDER_RIGHT, char_height - y - 1, 1);
+
+  // upload rotated bitmap to its atlas cell
+  if (pixmap2_ == None || glyph.width <= 0 || glyph.height <= 0)
+    return;
+
+  glyph.ax = (c1 % atlas_cols_)*atlas_width_;
+  glyph.ay = (c1 / atlas_cols_)*atlas_height_;
+
+  XImage *gimage = XCreateImage(display_, DefaultVisual(display_, DefaultScreen(display_)),
+                                1, XYBitmap, 0, reinterpret_cast<char *>(&glyph.bits[0]),
+                                uint(glyph.width), uint(glyph.height), 8, dbpl);
+
+  if (! gimage)
+    return;
+
+  gimage->byte_order       = LSBFirst;
+  gimage->bitmap_bit_order = LSBFirst;
+
+  XInitImage(gimage);
+
+  XPutImage(display_, pixmap2_, gc_, gimage, 0, 0, glyph.ax, glyph.ay,
+            uint(glyph.width), uint(glyph.height));
+
+  gimage->data = nullptr;
+
+  XDestroyImage(gimage);
+}
+
+// bounding box of rectangle (0, 0, w, h) rotated about origin
+void
+CXrtFont::
+getRotatedRect(int w, int h, int *x, int *y, int *rw, int *rh) const
+{
+  double xc[4] = { 0, double(w), 0, double(w) };
+  double yc[4] = { 0, 0, double(h), double(h) };
+
+  double xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+
+  for (int i = 0; i < 4; i++) {
+    double xr =  xc[i]*cos_ + yc[i]*sin_;
+    double yr = -xc[i]*sin_ + yc[i]*cos_;
+
+    if (i == 0 || xr < xmin) xmin = xr;
+    if (i == 0 || xr > xmax) xmax = xr;
+    if (i == 0 || yr < ymin) ymin = yr;
+    if (i == 0 || yr > ymax) ymax = yr;
   }
 
-  rotated_[c1] = true;
+  *x  = int(std::floor(xmin));
+  *y  = int(std::floor(ymin));
+  *rw = int(std::ceil (xmax)) - *x;
+  *rh = int(std::ceil (ymax)) - *y;
+}
+
+int
+CXrtFont::
+getCharWidth(int c1) const
+{
+  if (fs_->per_char)
+    return fs_->per_char[c1].width;
+  else
+    return fs_->min_bounds.width;
 }
 
 XFontStruct *
@@ -642,9 +750,50 @@ getFontStruct()
   return fs_;
 }
 
-int
-CXrtFont::
-XErrorHandler(Display *, XErrorEvent *)
+//------
+
+// transpose 8x8 bit matrix (byte r bit c <-> byte c bit r)
+static uint64_t
+transpose8x8(uint64_t m)
 {
-  return False;
+  uint64_t t;
+
+  t = (m ^ (m >>  7)) & 0x00AA00AA00AA00AAULL; m ^= t ^ (t <<  7);
+  t = (m ^ (m >> 14)) & 0x0000CCCC0000CCCCULL; m ^= t ^ (t << 14);
+  t = (m ^ (m >> 28)) & 0x00000000F0F0F0F0ULL; m ^= t ^ (t << 28);
+
+  return m;
+}
+
+// transpose w x h bitmap (1 bpp rows, LSB first) to h x w in 8x8 blocks.
+// Flipping source rows rotates by 270 and flipping destination rows by 90
+// (destination must be zeroed)
+static void
+transposeBits(const uchar *src, int w, int h, uchar *dst, bool flip_src, bool flip_dst)
+{
+  int sbpl = (w + 7)/8;
+  int dbpl = (h + 7)/8;
+
+  for (int by = 0; by < h; by += 8) {
+    for (int bx = 0; bx < sbpl; bx++) {
+      uint64_t m = 0;
+
+      for (int r = 0; r < 8 && by + r < h; r++) {
+        int sy = (flip_src ? h - 1 - (by + r) : by + r);
+
+        m |= uint64_t(src[sy*sbpl + bx]) << (8*r);
+      }
+
+      if (! m)
+        continue;
+
+      m = transpose8x8(m);
+
+      for (int r = 0; r < 8 && 8*bx + r < w; r++) {
+        int dy = (flip_dst ? w - 1 - (8*bx + r) : 8*bx + r);
+
+        dst[dy*dbpl + by/8] = uchar(m >> (8*r));
+      }
+    }
+  }
 }